@@ -29,6 +29,10 @@ set projectName=shader-baker
 set debugOptions=/MTd /Ob0 /Od /Zi
 set releaseOptions=/MT /O2 /Oi
 
+rem "build-windows stats" keeps statistics on the memory stacks, which the
+rem memory-stats command shows
+if /I "%~1"=="stats" set debugOptions=%debugOptions% /DMEM_STACK_STATS
+
 set ignoredWarnings=/wd4100 /wd4996 /wd4505
 
 set libraries=Gdi32.lib opengl32.lib User32.lib
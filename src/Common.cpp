@@ -1,12 +1,32 @@
 #include "Common.h"
 
 #include <cassert>
+#include <cstdlib>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-bool memStackInit(MemStack& stack, size_t capacity)
+/// Rounds a pointer up to a multiple of an alignment, which must be a power of two
+inline u8* alignPointer(u8 *p, size_t alignment)
+{
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+	return (u8*) (((uintptr_t) p + alignment - 1) & ~(uintptr_t) (alignment - 1));
+}
+
+/// Memory is committed in blocks of this size, so that a stack that grows a
+/// little at a time does not call into the system on every push
+static const size_t memStackCommitBlockSize = 64 * 1024;
+
+/// Reserves the capacity of a stack, without committing any of it. Capacity that
+/// is never pushed to costs nothing but address space, so it can be generous.
+/// Once the stack has grown past its retained size, it gives the memory past
+/// that back when it is popped or cleared down to it. By default, it keeps all
+/// memory it has committed.
+bool memStackInit(MemStack& stack, size_t capacity, size_t retainedSize = ~(size_t) 0)
 {
 	assert(capacity > 0);
 	
-	auto memory = (u8*) PLATFORM_alloc(capacity);
+	auto memory = (u8*) PLATFORM_reserve(capacity);
 	if (memory == nullptr)
 	{
 		return false;
@@ -15,20 +35,180 @@ bool memStackInit(MemStack& stack, size_t capacity)
 	stack.begin = memory;
 	stack.top = memory;
 	stack.end = memory + capacity;
+	stack.committedEnd = memory;
+	stack.retainedSize = retainedSize;
+	stack.onFailure = nullptr;
+	stack.failureData = nullptr;
+#ifdef MEM_STACK_STATS
+	stack.highWater = 0;
+	stack.pushCount = 0;
+	stack.pushedBytes = 0;
+	stack.sites = nullptr;
+#endif
+	return true;
+}
+
+/// Releases all of a stack's memory
+void memStackFree(MemStack& stack)
+{
+	if (stack.begin != nullptr)
+	{
+		auto freeResult = PLATFORM_free(stack.begin, stack.end - stack.begin);
+		assert(freeResult);
+	}
+	stack = {};
+}
+
+/// Commits the memory of a stack up to at least an address. Pushes do this
+/// themselves, so this is only needed to touch memory past the top of the stack.
+bool memStackCommit(MemStack& mem, u8 *p)
+{
+	assert(p <= mem.end);
+	if (p <= mem.committedEnd)
+	{
+		return true;
+	}
+
+	auto newCommittedEnd = alignPointer(p, memStackCommitBlockSize);
+	if (newCommittedEnd > mem.end)
+	{
+		newCommittedEnd = mem.end;
+	}
+	if (!PLATFORM_commit(mem.committedEnd, newCommittedEnd - mem.committedEnd))
+	{
+		return false;
+	}
+	mem.committedEnd = newCommittedEnd;
 	return true;
 }
 
-//TODO memory alignment
-inline void* memStackPush(MemStack& mem, size_t size)
+/// Decommits what is past the retained size of a stack, once the stack is back
+/// down to it. A stack that is popped while it is still above its retained size
+/// keeps its memory, so that pushing and popping around one size does not commit
+/// and decommit the same pages over and over.
+static void memStackTrim(MemStack& mem)
+{
+	if ((size_t) (mem.top - mem.begin) > mem.retainedSize)
+	{
+		return;
+	}
+
+	auto retainedEnd = alignPointer(mem.begin + mem.retainedSize, memStackCommitBlockSize);
+	if (retainedEnd < mem.committedEnd)
+	{
+		PLATFORM_decommit(retainedEnd, mem.committedEnd - retainedEnd);
+		mem.committedEnd = retainedEnd;
+	}
+}
+
+/// Called when a stack cannot grow to fit a push
+static void memStackFail(MemStack& mem)
+{
+	if (mem.onFailure != nullptr)
+	{
+		mem.onFailure(mem, mem.failureData);
+	}
+	// Carrying on would write past the end of the stack
+	assert(false);
+	abort();
+}
+
+#ifdef MEM_STACK_STATS
+static void memStackRecordPush(MemStack& mem, size_t size, MemStackSite site)
+{
+	auto used = (size_t) (mem.top - mem.begin);
+	if (used > mem.highWater)
+	{
+		mem.highWater = used;
+	}
+	++mem.pushCount;
+	mem.pushedBytes += size;
+
+	auto table = mem.sites;
+	if (table == nullptr)
+	{
+		return;
+	}
+	// A site passes the same file name every time, so it is enough to compare the
+	// pointers. The table is kept at most three quarters full, so probes are short.
+	auto mask = memStackSiteTableCapacity - 1;
+	auto slot = ((u32) ((uintptr_t) site.file >> 3) ^ site.line) * 0x9E3779B1 & mask;
+	for (;;)
+	{
+		auto& entry = table->sites[slot];
+		if (entry.site.file == site.file && entry.site.line == site.line)
+		{
+			++entry.pushCount;
+			entry.pushedBytes += size;
+			return;
+		}
+		if (entry.site.file == nullptr)
+		{
+			if (table->siteCount >= memStackSiteTableCapacity / 4 * 3)
+			{
+				++table->untrackedPushCount;
+				return;
+			}
+			entry.site = site;
+			entry.pushCount = 1;
+			entry.pushedBytes = size;
+			++table->siteCount;
+			return;
+		}
+		slot = (slot + 1) & mask;
+	}
+}
+#endif
+
+/// Pushes memory right at the top of the stack, with no padding before it. This
+/// is for bytes, and for memory that continues what was pushed before it.
+/// Everything else is pushed with memStackPushType and memStackPushArray, which
+/// align it for its type.
+inline void* memStackPushTagged(MemStack& mem, size_t size MEM_STACK_SITE_PARAM)
 {
 	size_t remainingSize = mem.end - mem.top;
-//TODO figure out how to "gracefully crash" the application if memory runs out
-	assert(size <= remainingSize);
+	if (size > remainingSize)
+	{
+		memStackFail(mem);
+	}
 	auto result = mem.top;
+	if (result + size > mem.committedEnd && !memStackCommit(mem, result + size))
+	{
+		memStackFail(mem);
+	}
  	mem.top += size;
+#ifdef MEM_STACK_STATS
+	memStackRecordPush(mem, size, site);
+#endif
 	return result;
 }
 
+inline void* memStackPushAlignedTagged(MemStack& mem, size_t size, size_t alignment MEM_STACK_SITE_PARAM)
+{
+	auto result = alignPointer(mem.top, alignment);
+	if (result > mem.end || size > (size_t) (mem.end - result))
+	{
+		memStackFail(mem);
+	}
+	if (result + size > mem.committedEnd && !memStackCommit(mem, result + size))
+	{
+		memStackFail(mem);
+	}
+	mem.top = result + size;
+#ifdef MEM_STACK_STATS
+	memStackRecordPush(mem, size, site);
+#endif
+	return result;
+}
+
+/// Pads the top of the stack to an alignment, and returns it. This is for arrays
+/// that are pushed one element at a time, whose beginning is taken before the
+/// first element is pushed.
+inline void* memStackAlign(MemStack& mem, size_t alignment)
+{
+	return memStackPushAligned(mem, 0, alignment);
+}
+
 inline MemStackMarker memStackMark(MemStack const& mem)
 {
 	return MemStackMarker{mem.top};
@@ -38,11 +218,91 @@ inline void memStackPop(MemStack& mem, MemStackMarker marker)
 {
 	assert(marker.p >= mem.begin && marker.p < mem.end);
 	mem.top = marker.p;
+	if ((size_t) (mem.committedEnd - mem.begin) > mem.retainedSize)
+	{
+		memStackTrim(mem);
+	}
 }
 
 inline void memStackClear(MemStack& mem)
 {
 	mem.top = mem.begin;
+	if ((size_t) (mem.committedEnd - mem.begin) > mem.retainedSize)
+	{
+		memStackTrim(mem);
+	}
+}
+
+/// Adds a stack to a registry. The stack must not move while it is registered.
+void memStackRegister(MemStackRegistry& registry, MemStack const& stack, char const *name, u32 ownerThread)
+{
+	assert(registry.count < maxRegisteredMemStacks);
+	auto& registration = registry.registrations[registry.count];
+	registration.name = name;
+	registration.stack = &stack;
+	registration.ownerThread = ownerThread;
+#ifdef MEM_STACK_STATS
+	registration.frameStartPushCount = stack.pushCount;
+	registration.frameStartPushedBytes = stack.pushedBytes;
+	registration.lastFramePushCount = 0;
+	registration.lastFramePushedBytes = 0;
+#endif
+	++registry.count;
+}
+
+/// Adds up the memory use of all registered stacks. Worker stacks are read
+/// without synchronizing with their threads, so this is only called while no
+/// jobs are running.
+MemStackUsage memStackRegistryUsage(MemStackRegistry const& registry)
+{
+	MemStackUsage usage = {};
+	for (u32 i = 0; i < registry.count; ++i)
+	{
+		auto& stack = *registry.registrations[i].stack;
+		usage.used += stack.top - stack.begin;
+		usage.committed += stack.committedEnd - stack.begin;
+		usage.reserved += stack.end - stack.begin;
+	}
+	return usage;
+}
+
+/// Returns the index of the lowest set bit. The value must not be zero.
+inline u32 countTrailingZeros(u32 value)
+{
+	assert(value != 0);
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return index;
+#else
+	return __builtin_ctz(value);
+#endif
+}
+
+/// Returns the index of the lowest set bit. The value must not be zero.
+inline u32 countTrailingZeros64(u64 value)
+{
+	assert(value != 0);
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return index;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+/// Returns the index of the highest set bit. The value must not be zero.
+inline u32 highestSetBit(u32 value)
+{
+	assert(value != 0);
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, value);
+	return index;
+#else
+	return 31 - __builtin_clz(value);
+#endif
 }
 
 /// Finds the length of a C string, excluding the null terminator
@@ -143,7 +403,7 @@ inline StringSlice memStackPushString(MemStack& mem, StringSlice str)
 	return StringSlice{ptr, ptr + stringLength};
 }
 
-inline StringSlice memStackPushCString(MemStack& mem, char *str)
+inline StringSlice memStackPushCString(MemStack& mem, char const *str)
 {
 	StringSlice result;
 	result.begin = (char*) mem.top;
@@ -175,7 +435,7 @@ inline PackedString endPackedString(MemStack& mem, PackedStringBuilder builder)
 inline PackedString packString(MemStack& mem, StringSlice str)
 {
 	size_t stringLength = stringSliceLength(str);
-	auto ptr = memStackPush(mem, sizeof(stringLength) + stringLength);
+	auto ptr = memStackPushAligned(mem, sizeof(stringLength) + stringLength, alignof(size_t));
 	auto sizePtr = (size_t*) ptr;
 	auto charPtr = (char*) (sizePtr + 1);
 	*sizePtr = stringLength;
@@ -210,6 +470,14 @@ inline size_t packedStringLength(PackedString str)
 	return *((size_t*) str.ptr);
 }
 
+/// Finds the string packed right after another one. The size of a packed string
+/// is aligned, so there may be padding between the two.
+inline PackedString nextPackedString(PackedString str)
+{
+	auto end = (u8*) str.ptr + sizeof(size_t) + packedStringLength(str);
+	return PackedString{alignPointer(end, alignof(size_t))};
+}
+
 void u32ToString(MemStack& mem, u32 value, char*& result, u32& length)
 {
 	// 10 characters is large enough to hold any 32 bit integer
@@ -241,3 +509,244 @@ void u32ToString(MemStack& mem, u32 value, char*& result, u32& length)
 	mem.top = (u8*) resultEnd;
 }
 
+
+inline u64 rotateLeft(u64 value, u32 shift)
+{
+	return (value << shift) | (value >> (64 - shift));
+}
+
+inline u64 readU64Unaligned(u8 const *p)
+{
+	u64 result;
+	memcpy(&result, p, sizeof(result));
+	return result;
+}
+
+inline u32 readU32Unaligned(u8 const *p)
+{
+	u32 result;
+	memcpy(&result, p, sizeof(result));
+	return result;
+}
+
+/// Computes a 64 bit, non-cryptographic hash of a block of memory. This follows
+/// the structure of xxHash64: four independent lanes consume 32 byte stripes, so
+/// long inputs hash at close to memory bandwidth.
+u64 hashBytes(void const *data, size_t size, u64 seed = 0)
+{
+	const u64 prime1 = 0x9E3779B185EBCA87ull;
+	const u64 prime2 = 0xC2B2AE3D27D4EB4Full;
+	const u64 prime3 = 0x165667B19E3779F9ull;
+	const u64 prime4 = 0x85EBCA77C2B2AE63ull;
+	const u64 prime5 = 0x27D4EB2F165667C5ull;
+
+	auto p = (u8 const*) data;
+	auto end = p + size;
+	u64 hash;
+
+	if (size >= 32)
+	{
+		u64 lanes[4] = {seed + prime1 + prime2, seed + prime2, seed, seed - prime1};
+		auto stripesEnd = end - 32;
+		do
+		{
+			for (u32 i = 0; i < 4; ++i)
+			{
+				lanes[i] += readU64Unaligned(p + 8 * i) * prime2;
+				lanes[i] = rotateLeft(lanes[i], 31) * prime1;
+			}
+			p += 32;
+		} while (p <= stripesEnd);
+
+		hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7)
+			+ rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+		for (u32 i = 0; i < 4; ++i)
+		{
+			hash ^= rotateLeft(lanes[i] * prime2, 31) * prime1;
+			hash = hash * prime1 + prime4;
+		}
+	} else
+	{
+		hash = seed + prime5;
+	}
+
+	hash += (u64) size;
+
+	while (end - p >= 8)
+	{
+		hash ^= rotateLeft(readU64Unaligned(p) * prime2, 31) * prime1;
+		hash = rotateLeft(hash, 27) * prime1 + prime4;
+		p += 8;
+	}
+	if (end - p >= 4)
+	{
+		hash ^= (u64) readU32Unaligned(p) * prime1;
+		hash = rotateLeft(hash, 23) * prime2 + prime3;
+		p += 4;
+	}
+	while (p != end)
+	{
+		hash ^= (*p) * prime5;
+		hash = rotateLeft(hash, 11) * prime1;
+		++p;
+	}
+
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+inline u64 hashStringSlice(StringSlice str, u64 seed = 0)
+{
+	return hashBytes(str.begin, stringSliceLength(str), seed);
+}
+
+/// Mixes a hash into a running hash. The result depends on the order hashes are combined in.
+inline u64 combineHashes(u64 runningHash, u64 hash)
+{
+	runningHash ^= rotateLeft(hash * 0xC2B2AE3D27D4EB4Full, 31) * 0x9E3779B185EBCA87ull;
+	return runningHash * 0x9E3779B185EBCA87ull + 0x85EBCA77C2B2AE63ull;
+}
+
+#ifdef MEM_STACK_STATS
+/// Starts a new frame. What was pushed to each stack since the last call is
+/// kept as what the last frame pushed. Called while no jobs are running.
+void memStackRegistryEndFrame(MemStackRegistry& registry)
+{
+	for (u32 i = 0; i < registry.count; ++i)
+	{
+		auto& registration = registry.registrations[i];
+		auto& stack = *registration.stack;
+		// A stack that was freed and initialized again during the frame counts from zero
+		if (stack.pushCount < registration.frameStartPushCount)
+		{
+			registration.frameStartPushCount = 0;
+			registration.frameStartPushedBytes = 0;
+		}
+		registration.lastFramePushCount = stack.pushCount - registration.frameStartPushCount;
+		registration.lastFramePushedBytes = stack.pushedBytes - registration.frameStartPushedBytes;
+		registration.frameStartPushCount = stack.pushCount;
+		registration.frameStartPushedBytes = stack.pushedBytes;
+	}
+}
+
+static void pushKilobytes(MemStack& mem, u64 bytes)
+{
+	char *unused1;
+	u32 unused2;
+	u32ToString(mem, (u32) ((bytes + 1023) / 1024), unused1, unused2);
+	memStackPushCString(mem, " KB");
+}
+
+/// Writes a line for each registered stack that has memory reserved, and for
+/// each of the sites that pushed the most bytes to the stacks that count pushes
+/// by site. The report is pushed to a stack, and its own pushes are not counted
+/// by site.
+StringSlice memStackStatsReport(
+	MemStack& mem, MemStackRegistry const& registry, MemStackSiteTable const *sites, u32 maxSiteCount)
+{
+	auto memSites = mem.sites;
+	mem.sites = nullptr;
+
+	char *unused1;
+	u32 unused2;
+	auto begin = (char*) mem.top;
+	for (u32 i = 0; i < registry.count; ++i)
+	{
+		auto& registration = registry.registrations[i];
+		auto& stack = *registration.stack;
+		if (stack.begin == nullptr)
+		{
+			continue;
+		}
+		memStackPushCString(mem, registration.name);
+		if (registration.ownerThread != 0)
+		{
+			memStackPushCString(mem, " ");
+			u32ToString(mem, registration.ownerThread, unused1, unused2);
+		}
+		memStackPushCString(mem, ": used ");
+		pushKilobytes(mem, stack.top - stack.begin);
+		memStackPushCString(mem, ", committed ");
+		pushKilobytes(mem, stack.committedEnd - stack.begin);
+		memStackPushCString(mem, ", high water ");
+		pushKilobytes(mem, stack.highWater);
+		memStackPushCString(mem, ", last frame ");
+		u32ToString(mem, (u32) registration.lastFramePushCount, unused1, unused2);
+		memStackPushCString(mem, " pushes of ");
+		pushKilobytes(mem, registration.lastFramePushedBytes);
+		memStackPushCString(mem, "\n");
+	}
+
+	auto usage = memStackRegistryUsage(registry);
+	memStackPushCString(mem, "all stacks: used ");
+	pushKilobytes(mem, usage.used);
+	memStackPushCString(mem, ", committed ");
+	pushKilobytes(mem, usage.committed);
+	memStackPushCString(mem, ", reserved ");
+	pushKilobytes(mem, usage.reserved);
+
+	if (sites != nullptr)
+	{
+		// The sites are listed from the most bytes pushed to the least. Each is the
+		// largest that comes after the one before it, breaking ties by slot.
+		u64 previousBytes = ~(u64) 0;
+		u32 previousSlot = memStackSiteTableCapacity;
+		for (u32 i = 0; i < maxSiteCount; ++i)
+		{
+			u32 nextSlot = memStackSiteTableCapacity;
+			for (u32 slot = 0; slot < memStackSiteTableCapacity; ++slot)
+			{
+				auto& entry = sites->sites[slot];
+				bool afterPrevious = entry.pushedBytes < previousBytes
+					|| (entry.pushedBytes == previousBytes && slot > previousSlot);
+				if (entry.site.file == nullptr || !afterPrevious)
+				{
+					continue;
+				}
+				if (nextSlot == memStackSiteTableCapacity
+					|| entry.pushedBytes > sites->sites[nextSlot].pushedBytes)
+				{
+					nextSlot = slot;
+				}
+			}
+			if (nextSlot == memStackSiteTableCapacity)
+			{
+				break;
+			}
+
+			auto& entry = sites->sites[nextSlot];
+			auto fileName = entry.site.file;
+			for (auto p = entry.site.file; *p != '\0'; ++p)
+			{
+				if (*p == '/' || *p == '\\')
+				{
+					fileName = p + 1;
+				}
+			}
+			memStackPushCString(mem, "\n");
+			memStackPushCString(mem, fileName);
+			memStackPushCString(mem, ":");
+			u32ToString(mem, entry.site.line, unused1, unused2);
+			memStackPushCString(mem, ": ");
+			u32ToString(mem, entry.pushCount, unused1, unused2);
+			memStackPushCString(mem, " pushes of ");
+			pushKilobytes(mem, entry.pushedBytes);
+			previousBytes = entry.pushedBytes;
+			previousSlot = nextSlot;
+		}
+		if (sites->untrackedPushCount != 0)
+		{
+			memStackPushCString(mem, "\n");
+			u32ToString(mem, sites->untrackedPushCount, unused1, unused2);
+			memStackPushCString(mem, " pushes from sites that did not fit in the table");
+		}
+	}
+
+	mem.sites = memSites;
+	return StringSlice{begin, (char*) mem.top};
+}
+#endif
@@ -1,13 +1,90 @@
 #pragma once
 
-#define arrayLength(array) sizeof(array) / sizeof(array[0])
-#define memStackPushType(mem, type) (type*) memStackPush(mem, sizeof(type))
-#define memStackPushArray(mem, type, size) (type*) memStackPush(mem, (size) * sizeof(type))
+/// Building with MEM_STACK_STATS defined keeps statistics on memory stacks: how
+/// far each one has grown, how much is pushed to each one per frame, and how
+/// many pushes are made from each line of code. Without it, none of this is
+/// compiled in, and pushes do not pass where they were made from.
+#ifdef MEM_STACK_STATS
+#define MEM_STACK_SITE_PARAM , MemStackSite site
+#define MEM_STACK_SITE_ARG , MemStackSite{__FILE__, __LINE__}
+#else
+#define MEM_STACK_SITE_PARAM
+#define MEM_STACK_SITE_ARG
+#endif
+
+#define arrayLength(array) (sizeof(array) / sizeof((array)[0]))
+#define memStackPush(mem, size) memStackPushTagged(mem, size MEM_STACK_SITE_ARG)
+#define memStackPushAligned(mem, size, alignment) memStackPushAlignedTagged(mem, size, alignment MEM_STACK_SITE_ARG)
+#define memStackPushType(mem, type) (type*) memStackPushAligned(mem, sizeof(type), alignof(type))
+#define memStackPushArray(mem, type, size) (type*) memStackPushAligned(mem, (size) * sizeof(type), alignof(type))
+/// Pushes an array aligned more than its type needs to be, such as for SIMD
+/// loads or to keep memory used by different threads on different cache lines
+#define memStackPushArrayAligned(mem, type, size, alignment) \
+	(type*) memStackPushAligned(mem, (size) * sizeof(type), alignment)
 #define unreachable() assert(false)
 
+/// The size of a cache line on x64 processors. Text that is scanned 16 bytes at
+/// a time from its beginning is aligned to this, so that no load straddles two lines.
+const size_t cacheLineSize = 64;
+
+#ifdef MEM_STACK_STATS
+/// The line of code a push was made from
+struct MemStackSite
+{
+	char const *file;
+	u32 line;
+};
+
+struct MemStackSiteStats
+{
+	MemStackSite site;
+	u32 pushCount;
+	u64 pushedBytes;
+};
+
+const u32 memStackSiteTableCapacity = 1024;
+
+/// Counts pushes by the line of code they were made from. Only stacks that
+/// point to a table are counted, and the stacks that share a table must all
+/// be used by the same thread.
+struct MemStackSiteTable
+{
+	u32 siteCount;
+	/// Pushes from sites that did not fit in the table
+	u32 untrackedPushCount;
+	/// An open addressing hash table
+	MemStackSiteStats sites[memStackSiteTableCapacity];
+};
+#endif
+
+struct MemStack;
+/// Called when a stack cannot fit a push, because the push would run past the
+/// end of what the stack reserved, or the system has no memory left to commit.
+/// It must not return, so it either ends the program or jumps out of whatever
+/// was pushing.
+typedef void MemStackFailureProc(MemStack& mem, void *data);
+
+/// A stack of memory whose whole capacity is reserved up front, but which is
+/// only backed by memory as it grows
 struct MemStack
 {
 	u8 *begin, *top, *end;
+	/// The memory from the beginning of the stack up to here is committed. The
+	/// rest, up to the end, is only reserved.
+	u8 *committedEnd;
+	/// When the stack is popped or cleared down to this many bytes, committed
+	/// memory past it is given back to the system
+	size_t retainedSize;
+	/// Without a failure procedure, a stack that cannot grow ends the program
+	MemStackFailureProc *onFailure;
+	void *failureData;
+#ifdef MEM_STACK_STATS
+	/// The most the stack has ever held
+	size_t highWater;
+	/// Totals over the life of the stack
+	u64 pushCount, pushedBytes;
+	MemStackSiteTable *sites;
+#endif
 };
 
 struct MemStackMarker
@@ -15,6 +92,51 @@ struct MemStackMarker
 	u8 *p;
 };
 
+/// Scratch stacks for the threads that jobs run on, by thread index. Thread zero
+/// is the thread that runs the jobs, which does the first job itself. A job only
+/// pushes to the stack of its own thread, so threads never share a stack. The
+/// stacks are kept from one run of jobs to the next, so what they commit is
+/// reused. Jobs mark their stack when they start, and the results of a job are
+/// popped once whoever runs the jobs is done with them.
+struct WorkerMemStacks
+{
+	u32 count;
+	MemStack *stacks;
+};
+
+/// What a stack is for, and which thread pushes to it
+struct MemStackRegistration
+{
+	char const *name;
+	MemStack const *stack;
+	/// Zero for the main thread, or the thread index of a worker stack
+	u32 ownerThread;
+#ifdef MEM_STACK_STATS
+	/// The stack's push totals when the current frame began
+	u64 frameStartPushCount, frameStartPushedBytes;
+	/// What was pushed to the stack during the last frame
+	u64 lastFramePushCount, lastFramePushedBytes;
+#endif
+};
+
+const u32 maxRegisteredMemStacks = 512;
+
+/// Keeps track of all of a program's stacks, so that their memory use can be
+/// reported together
+struct MemStackRegistry
+{
+	u32 count;
+	MemStackRegistration registrations[maxRegisteredMemStacks];
+};
+
+struct MemStackUsage
+{
+	/// Pushed and not yet popped
+	size_t used;
+	size_t committed;
+	size_t reserved;
+};
+
 struct StringSlice
 {
 	char *begin, *end;
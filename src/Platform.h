@@ -18,11 +18,62 @@ enum class ReadFileError
 
 	/// Some other error occured. File reading routines should be
 	/// able to catch more specific errors, but we can't trust
-	/// OS documentation to give us all the possible errors.
+	/// OS documentation to give us all the possible errors. Also
+	/// used when a file becomes shorter while it is streamed.
 	Other,
 };
 
-void* PLATFORM_alloc(size_t size);
-bool PLATFORM_free(void* memory);
+/// Reserves a range of address space, which is not backed by memory until it is committed
+void* PLATFORM_reserve(size_t size);
+/// Backs reserved pages with memory, which reads as zeros until it is written
+bool PLATFORM_commit(void* memory, size_t size);
+/// Gives the memory backing committed pages back to the system. The pages stay reserved.
+void PLATFORM_decommit(void* memory, size_t size);
+/// Releases a reserved range, which must be the whole of what was reserved
+bool PLATFORM_free(void* memory, size_t size);
 void PLATFORM_readWholeFile(MemStack&, FilePath const, ReadFileError&, u8*& fileContents, size_t& fileSize);
+/// Replaces the contents of a file, creating the file if it does not exist
+bool PLATFORM_writeWholeFile(MemStack& scratchMem, FilePath const, void const *data, size_t size);
 
+/// A read-only view of a file's contents
+struct MappedFile
+{
+	void *data;
+	size_t size;
+};
+
+bool PLATFORM_mapFile(MemStack& scratchMem, FilePath const, MappedFile&);
+void PLATFORM_unmapFile(MappedFile&);
+/// Gets a number that changes whenever the file is written to
+bool PLATFORM_getFileWriteStamp(MemStack& scratchMem, FilePath const, u64& stamp);
+
+/// A file that is read in pieces. A read runs in the background, so the piece
+/// read before it can be processed while it runs.
+struct FileStream
+{
+	void *handle;
+	/// What the platform needs to keep track of a read
+	void *readState;
+	bool reading;
+	u64 size;
+	/// Where the next read starts
+	u64 offset;
+};
+
+/// Opens a file to read in pieces. The stream keeps data in the memory stack,
+/// which must not be popped until the stream is closed.
+bool PLATFORM_openFileStream(MemStack& mem, FilePath const, ReadFileError&, FileStream&);
+/// Starts reading the next piece of the file into a buffer, without waiting for
+/// the read to finish. Only one read can run at a time.
+bool PLATFORM_startFileStreamRead(FileStream&, void *buffer, u32 size, ReadFileError&);
+/// Waits for the running read to finish
+bool PLATFORM_finishFileStreamRead(FileStream&, u32& bytesRead, ReadFileError&);
+void PLATFORM_closeFileStream(FileStream&);
+
+
+typedef void PlatformJobProc(void *data);
+
+u32 PLATFORM_processorCount();
+/// Runs a procedure on each element of an array of jobs, with each job on its own
+/// thread, and returns once all of them have finished
+void PLATFORM_runJobs(MemStack& scratchMem, PlatformJobProc *proc, void *jobs, size_t jobSize, u32 jobCount);
@@ -1,19 +1,29 @@
 #include "Project.h"
 
+#include <cfloat>
+#include <cstdlib>
+#include <emmintrin.h>
+
 //TODO consider restricting the available characters for identifiers
 
-inline static TextLocation parserTextLocation(ProjectParser& parser)
-{
-	auto charNumber = (u32) (parser.cursor - parser.lineBegin + 1);
-	return TextLocation{parser.cursor, parser.lineNumber, charNumber};
-}
+/// Errors past this many are dropped, and parsing stops once it is reached, so
+/// that text that is not a project at all does not take long to reject
+static const u32 maxProjectErrors = 100;
 
+/// Errors only record where they are in the text. Their line and character
+/// numbers are found once parsing is done, so that the parser does not keep
+/// track of lines.
 inline static void addError(
-	MemStack& mem, ProjectParser& parser, TextLocation location, ProjectErrorType errorType)
+	MemStack& mem, ProjectParser& parser, char *location, ProjectErrorType errorType)
 {
+	if (parser.errorCount >= maxProjectErrors)
+	{
+		return;
+	}
+
 	auto error = memStackPushType(mem, ParseProjectError);
 	error->type = errorType;
-	error->location = location;
+	error->offset = (u32) (location - parser.textBegin);
 	error->next = parser.errors;
 	parser.errors = error;
 	++parser.errorCount;
@@ -21,7 +31,7 @@ inline static void addError(
 
 inline static void addError(MemStack& mem, ProjectParser& parser, ProjectErrorType errorType)
 {
-	addError(mem, parser, parserTextLocation(parser), errorType);
+	addError(mem, parser, parser.cursor, errorType);
 } 
 
 inline static bool isDigit(char c)
@@ -43,40 +53,65 @@ inline static bool isWhitespace(char c)
 	}
 }
 
-inline static void skipChar(ProjectParser& parser, char c)
+// The lexer scans text 16 bytes at a time with SSE2, which every x64 processor
+// supports. Each comparison produces a bit mask with one bit per byte, where
+// bit 0 corresponds to the byte at the lowest address.
+
+inline static u32 byteMask(__m128i chars, char c)
+{
+	return (u32) _mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8(c)));
+}
+
+inline static u32 whitespaceMask(__m128i chars, u32 lfMask, u32 crMask)
+{
+	return lfMask | crMask | byteMask(chars, ' ') | byteMask(chars, '\t');
+}
+
+/// Returns the first character at or after p that is not whitespace, or the end
+static char* skipWhitespace(char *p, char *end)
 {
-	if (parser.cursor != parser.end && *parser.cursor == c)
+	while (end - p >= 16)
 	{
-		++parser.cursor;
+		auto chars = _mm_loadu_si128((__m128i*) p);
+		auto whitespace = whitespaceMask(chars, byteMask(chars, '\n'), byteMask(chars, '\r'));
+		auto nonWhitespace = ~whitespace & 0xFFFF;
+		if (nonWhitespace != 0)
+		{
+			return p + countTrailingZeros(nonWhitespace);
+		}
+		p += 16;
 	}
+
+	while (p != end && isWhitespace(*p))
+	{
+		++p;
+	}
+	return p;
 }
 
-static void skipWhitespace(ProjectParser& parser)
+/// Returns the first whitespace character at or after p, or the end
+static char* findWhitespace(char *p, char *end)
 {
-	while (parser.cursor != parser.end)
+	while (end - p >= 16)
 	{
-		switch (*parser.cursor)
+		auto chars = _mm_loadu_si128((__m128i*) p);
+		auto whitespace = whitespaceMask(chars, byteMask(chars, '\n'), byteMask(chars, '\r'));
+		if (whitespace != 0)
 		{
-		case '\n':
-			++parser.cursor;
-			++parser.lineNumber;
-			skipChar(parser, '\r');
-			parser.lineBegin = parser.cursor;
-			break;
-		case '\r':
-			++parser.cursor;
-			++parser.lineNumber;
-			skipChar(parser, '\n');
-			parser.lineBegin = parser.cursor;
-			break;
-		case ' ':
-		case '\t':
-			++parser.cursor;
-			break;
-		default:
-			return;
+			return p + countTrailingZeros(whitespace);
 		}
+		p += 16;
+	}
+	while (p != end && !isWhitespace(*p))
+	{
+		++p;
 	}
+	return p;
+}
+
+inline static void skipWhitespace(ProjectParser& parser)
+{
+	parser.cursor = skipWhitespace(parser.cursor, parser.end);
 }
 
 static Token readToken(ProjectParser& parser)
@@ -84,39 +119,300 @@ static Token readToken(ProjectParser& parser)
 	skipWhitespace(parser);
 
 	Token result = {};
-	result.location = parserTextLocation(parser);
-
 	result.str.begin = parser.cursor;
-	while (parser.cursor != parser.end && !isWhitespace(*parser.cursor))
-	{
-		++parser.cursor;
-	}
+	parser.cursor = findWhitespace(parser.cursor, parser.end);
 	result.str.end = parser.cursor;
 	return result;
 }
 
-static bool parseU32Base10(StringSlice str, u32& result)
+/// Finds the first occurrence of a string in a range of text, and returns a
+/// pointer to its beginning, or null if it does not occur. Candidate positions
+/// are found 16 at a time by matching the first and last characters of the
+/// string, and only candidates are compared in full.
+static char* findString(char *begin, char *end, StringSlice str)
+{
+	auto length = stringSliceLength(str);
+	assert(length > 0);
+	if ((size_t) (end - begin) < length)
+	{
+		return nullptr;
+	}
+
+	auto firstChar = _mm_set1_epi8(str.begin[0]);
+	auto lastChar = _mm_set1_epi8(str.end[-1]);
+	auto p = begin;
+	auto lastStart = end - length;
+	while (lastStart - p >= 15)
+	{
+		auto firstMatches = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) p), firstChar);
+		auto lastMatches = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) (p + length - 1)), lastChar);
+		auto candidates = (u32) _mm_movemask_epi8(_mm_and_si128(firstMatches, lastMatches));
+		while (candidates != 0)
+		{
+			auto candidate = p + countTrailingZeros(candidates);
+			if (memcmp(candidate, str.begin, length) == 0)
+			{
+				return candidate;
+			}
+			candidates &= candidates - 1;
+		}
+		p += 16;
+	}
+
+	while (p <= lastStart)
+	{
+		if (memcmp(p, str.begin, length) == 0)
+		{
+			return p;
+		}
+		++p;
+	}
+	return nullptr;
+}
+
+// Numbers are converted eight digits at a time. Eight characters are loaded as
+// one little endian word, so the first digit is in the lowest byte, and the
+// digits are combined pairwise with multiplies.
+
+static const u64 zeroDigits = 0x3030303030303030ull;
+
+/// Returns the value of eight digits, which are the bytes of a word minus '0',
+/// with the most significant digit in the lowest byte
+inline static u32 eightDigitsValue(u64 digits)
+{
+	const u64 mask = 0x000000FF000000FFull;
+	const u64 multiplier1 = 100 + (1000000ull << 32);
+	const u64 multiplier2 = 1 + (10000ull << 32);
+	digits = digits * 10 + (digits >> 8);
+	return (u32) (((digits & mask) * multiplier1 + ((digits >> 16) & mask) * multiplier2) >> 32);
+}
+
+static const u64 powersOf10[] = {
+	1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+};
+
+/// Reads a run of decimal digits, and appends them to the digits of a value.
+/// Returns the end of the run. The value is exact as long as it has at most 19
+/// digits in total, not counting leading zeros, which the caller checks.
+static char* readDigits(char *p, char *end, u64& value)
+{
+	while (end - p >= 8)
+	{
+		auto chars = readU64Unaligned((u8*) p);
+		// A character is a digit if its high nibble is 3, and adding 6 to it does
+		// not change that. Carries between bytes only reach bytes past the first
+		// one that is not a digit, which are not used.
+		auto nonDigits = ((chars & 0xF0F0F0F0F0F0F0F0ull) ^ zeroDigits)
+			| (((chars + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) ^ zeroDigits);
+		u32 digitCount = nonDigits == 0 ? 8 : countTrailingZeros64(nonDigits) / 8;
+		if (digitCount == 0)
+		{
+			return p;
+		}
+
+		// The digits are moved to the top of the word, which fills the bytes below
+		// them with zeros, the same as leading '0' characters
+		auto digits = (chars - zeroDigits) << (64 - 8 * digitCount);
+		value = value * powersOf10[digitCount] + eightDigitsValue(digits);
+		p += digitCount;
+		if (digitCount != 8)
+		{
+			return p;
+		}
+	}
+
+	while (p != end && isDigit(*p))
+	{
+		value = value * 10 + (u64) (*p - '0');
+		++p;
+	}
+	return p;
+}
+
+/// Parses a string of decimal digits, with no sign. Returns false if the
+/// string is not a number. A number that does not fit in 64 bits is too large.
+static bool parseDigitsBase10(StringSlice str, u64& result, bool& tooLarge)
 {
 	auto p = str.begin;
+	while (p != str.end && *p == '0')
+	{
+		++p;
+	}
+	auto significantBegin = p;
+
 	result = 0;
-	while (p != str.end)
+	p = readDigits(p, str.end, result);
+	if (p != str.end || str.begin == str.end)
+	{
+		return false;
+	}
+
+	// 20 digit numbers may be larger than the largest 64 bit number, but none of
+	// the callers need numbers that large, so they are all too large
+	tooLarge = str.end - significantBegin > 19;
+	return true;
+}
+
+static bool parseU32Base10(StringSlice str, u32& result, bool& tooLarge)
+{
+	u64 value;
+	if (!parseDigitsBase10(str, value, tooLarge))
+	{
+		return false;
+	}
+	tooLarge = tooLarge || value > 0xFFFFFFFFull;
+	result = (u32) value;
+	return true;
+}
+
+static bool parseU32Base10(StringSlice str, u32& result)
+{
+	bool tooLarge;
+	return parseU32Base10(str, result, tooLarge) && !tooLarge;
+}
+
+static bool parseI32Base10(StringSlice str, i32& result, bool& tooLarge)
+{
+	auto negative = str.begin != str.end && *str.begin == '-';
+	if (negative)
+	{
+		++str.begin;
+	}
+
+	u64 value;
+	if (!parseDigitsBase10(str, value, tooLarge))
+	{
+		return false;
+	}
+	// the magnitude of the smallest i32 is one more than that of the largest
+	tooLarge = tooLarge || value > 0x7FFFFFFFull + negative;
+	result = (i32) (negative ? 0 - (u32) value : (u32) value);
+	return true;
+}
+
+static const f64 exactPowersOf10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/// Parses a decimal number, with an optional sign, fraction, and exponent, to
+/// the nearest f32. Most numbers are converted with one multiply or divide of
+/// doubles, which is exact enough to round correctly. The rest are converted by
+/// strtof, which needs a null terminated copy of the string.
+static bool parseF32(MemStack& scratchMem, StringSlice str, f32& result, bool& tooLarge)
+{
+	tooLarge = false;
+	auto p = str.begin;
+	auto negative = p != str.end && *p == '-';
+	if (negative)
+	{
+		++p;
+	}
+
+	while (p != str.end && *p == '0')
+	{
+		++p;
+	}
+	u64 mantissa = 0;
+	auto integerBegin = p;
+	p = readDigits(p, str.end, mantissa);
+	auto significantDigitCount = p - integerBegin;
+	auto hasDigits = p != str.begin + negative;
+
+	i64 exponent = 0;
+	if (p != str.end && *p == '.')
 	{
-		auto c = *p;
-		if (!isDigit(c))
+		++p;
+		auto fractionBegin = p;
+		if (significantDigitCount == 0)
 		{
-			return false;
+			// zeros right after the point only move the point
+			while (p != str.end && *p == '0')
+			{
+				++p;
+			}
 		}
-//TODO check for overflow
-		result = result * 10 + (c - '0');
+		auto fractionDigitsBegin = p;
+		p = readDigits(p, str.end, mantissa);
+		significantDigitCount += p - fractionDigitsBegin;
+		exponent -= p - fractionBegin;
+		hasDigits = hasDigits || p != fractionBegin;
+	}
+	if (!hasDigits)
+	{
+		return false;
+	}
 
+	if (p != str.end && (*p == 'e' || *p == 'E'))
+	{
 		++p;
+		auto exponentNegative = p != str.end && *p == '-';
+		if (p != str.end && (*p == '-' || *p == '+'))
+		{
+			++p;
+		}
+		auto exponentBegin = p;
+		i64 exponentValue = 0;
+		while (p != str.end && isDigit(*p))
+		{
+			// large enough that any number is zero or infinite
+			if (exponentValue < 100000)
+			{
+				exponentValue = exponentValue * 10 + (*p - '0');
+			}
+			++p;
+		}
+		if (p == exponentBegin)
+		{
+			return false;
+		}
+		exponent += exponentNegative ? -exponentValue : exponentValue;
+	}
+	if (p != str.end)
+	{
+		return false;
+	}
+
+	if (significantDigitCount == 0)
+	{
+		result = negative ? -0.0f : 0.0f;
+		return true;
 	}
-	return str.end != str.begin;
+
+	// The mantissa and the power of ten are both exact doubles, so the one
+	// operation rounds correctly to a double. Rounding that to an f32 can only
+	// round differently than rounding the exact value if the double landed
+	// exactly halfway between two f32s.
+	if (significantDigitCount <= 15 && exponent >= -22 && exponent <= 22)
+	{
+		auto value = exponent < 0
+			? (f64) mantissa / exactPowersOf10[-exponent]
+			: (f64) mantissa * exactPowersOf10[exponent];
+		u64 bits;
+		memcpy(&bits, &value, sizeof(bits));
+		auto halfway = (bits & 0x1FFFFFFFull) == 0x10000000ull;
+		if (!halfway && value >= FLT_MIN && value <= FLT_MAX)
+		{
+			result = (f32) (negative ? -value : value);
+			return true;
+		}
+	}
+
+	auto memMarker = memStackMark(scratchMem);
+	auto length = stringSliceLength(str);
+	auto copy = memStackPushArray(scratchMem, char, length + 1);
+	memcpy(copy, str.begin, length);
+	copy[length] = '\0';
+	result = strtof(copy, nullptr);
+	memStackPop(scratchMem, memMarker);
+
+	tooLarge = result > FLT_MAX || result < -FLT_MAX;
+	return true;
 }
 
 static bool readHereString(MemStack& mem, ProjectParser& parser, StringSlice& result)
 {
-	auto hereStringLocation = parserTextLocation(parser);
+	auto hereStringLocation = parser.cursor;
 	if (parser.cursor == parser.end)
 	{
 		addError(mem, parser, hereStringLocation, ProjectErrorType::MissingHereStringMarker);
@@ -144,7 +440,7 @@ static bool readHereString(MemStack& mem, ProjectParser& parser, StringSlice& re
 
 		++parser.cursor;
 	}
-	auto hereStringMarker = StringSlice{hereStringLocation.srcPtr, parser.cursor};
+	auto hereStringMarker = StringSlice{hereStringLocation, parser.cursor};
 	auto markerLength = stringSliceLength(hereStringMarker);
 	if (markerLength == 0)
 	{
@@ -154,40 +450,216 @@ static bool readHereString(MemStack& mem, ProjectParser& parser, StringSlice& re
 	++parser.cursor;
 
 	auto strBegin = parser.cursor;
+	auto strEnd = findString(strBegin, parser.end, hereStringMarker);
+	if (strEnd == nullptr)
+	{
+		parser.cursor = parser.end;
+		addError(mem, parser, hereStringLocation, ProjectErrorType::UnclosedHereString);
+		return false;
+	}
+
+	parser.cursor = strEnd + markerLength;
+	result.begin = strBegin;
+	result.end = strEnd;
+	return true;
+}
+
+/// The source is hashed while it was just read, and is likely still in the cache
+inline static u64 shaderHash(ShaderType type, StringSlice source)
+{
+	return hashStringSlice(source, (u64) type);
+}
+
+/// The program's shaders must all be resolved
+static u64 programHash(Project const& project, u32 programIdx)
+{
+	auto begin = project.programAttachments[programIdx];
+	auto end = project.programAttachments[programIdx + 1];
+	u64 hash = end - begin;
+	for (auto i = begin; i < end; ++i)
+	{
+		auto shaderIdx = project.attachedShaders[i];
+		hash = combineHashes(hash, shaderIdx < project.shaderCount ? project.shaderHashes[shaderIdx] : 0);
+	}
+	return hash;
+}
+
+// Shaders and programs that the driver would certainly reject are reported as
+// project errors, so that a broken project does not cost a round trip through
+// the driver's compiler and linker to find out.
+
+inline static char* skipSpacesAndTabs(char *p, char *end)
+{
+	while (p != end && (*p == ' ' || *p == '\t'))
+	{
+		++p;
+	}
+	return p;
+}
+
+/// Returns the first character of a GLSL source at or after p that is not
+/// whitespace or in a comment, or the end
+static char* skipGlslComments(char *p, char *end)
+{
 	for (;;)
 	{
-		// if enough characters are available, check if the here string marker has been encounted
-		size_t strLength = parser.cursor - strBegin;
-		if (strLength >= markerLength)
+		p = skipWhitespace(p, end);
+		if (end - p < 2 || p[0] != '/')
+		{
+			return p;
+		}
+
+		if (p[1] == '/')
 		{
-			auto pStr = parser.cursor - markerLength;
-			auto pMarker = hereStringMarker.begin;
-			for (;;)
+			while (p != end && *p != '\n')
 			{
-				if (pMarker == hereStringMarker.end)
-				{
-					result.begin = strBegin;
-					result.end = parser.cursor - markerLength;
-					return true;
-				}
-				if (*pMarker != *pStr)
-				{
-					break;
-				}
-				++pMarker;
-				++pStr;
+				++p;
+			}
+		} else if (p[1] == '*')
+		{
+			p += 2;
+			while (end - p >= 2 && !(p[0] == '*' && p[1] == '/'))
+			{
+				++p;
+			}
+			if (end - p < 2)
+			{
+				return end;
 			}
+			p += 2;
+		} else
+		{
+			return p;
 		}
+	}
+}
 
-		skipWhitespace(parser);
+/// Reads the #version directive, which GLSL requires to come before anything
+/// else in a shader, other than comments and whitespace. A shader that does not
+/// begin with one is GLSL 110, which is what compilers take it to be. Returns
+/// false if the shader has the directive, but its version cannot be read. The
+/// location is where the version number is, or else where the directive would be.
+static bool readGlslVersion(StringSlice source, char*& location, u32& version, bool& es)
+{
+	auto end = source.end;
+	auto p = skipGlslComments(source.begin, end);
+	location = p;
+	version = 110;
+	es = false;
+	if (p == end || *p != '#')
+	{
+		return true;
+	}
 
-		if (parser.cursor == parser.end)
+	p = skipSpacesAndTabs(p + 1, end);
+	auto directiveEnd = p;
+	while (directiveEnd != end && !isWhitespace(*directiveEnd))
+	{
+		++directiveEnd;
+	}
+	if (StringSlice{p, directiveEnd} != "version")
+	{
+		return true;
+	}
+
+	p = skipSpacesAndTabs(directiveEnd, end);
+	location = p;
+	auto numberEnd = p;
+	while (numberEnd != end && isDigit(*numberEnd))
+	{
+		++numberEnd;
+	}
+	if (!parseU32Base10(StringSlice{p, numberEnd}, version))
+	{
+		return false;
+	}
+
+	p = skipSpacesAndTabs(numberEnd, end);
+	es = end - p >= 2 && p[0] == 'e' && p[1] == 's' && (end - p == 2 || isWhitespace(p[2]));
+	return true;
+}
+
+/// The first version of GLSL with each type of shader, indexed by shader type,
+/// for desktop GLSL and for GLSL ES
+static const u32 firstGlslVersions[][2] = {
+	{110, 100}, // Vertex
+	{150, 320}, // Geometry
+	{400, 320}, // TessControl
+	{400, 320}, // TessEvaluation
+	{110, 100}, // Fragment
+	{430, 310}, // Compute
+};
+
+/// Checks that the version of GLSL a shader is written in has the shader's
+/// type. Versions that cannot be read, or that do not exist, are left for the
+/// driver to report.
+static void checkGlslVersion(MemStack& mem, ProjectParser& parser, ShaderType shaderType, StringSlice source)
+{
+	char *location;
+	u32 version;
+	bool es;
+	if (readGlslVersion(source, location, version, es)
+		&& version < firstGlslVersions[(u32) shaderType][es ? 1 : 0])
+	{
+		addError(mem, parser, location, ProjectErrorType::GlslVersionUnsupportedByStage);
+	}
+}
+
+/// Checks the versions of the shaders that are attached to programs, which are
+/// the only ones that are ever compiled
+static void checkAttachedShaderVersions(MemStack& mem, ProjectParser& parser, Project const& project)
+{
+	auto attached = memStackPushArray(mem, bool, project.shaderCount);
+	memset(attached, 0, project.shaderCount * sizeof(bool));
+	for (u32 i = 0; i < project.attachedShaderCount; ++i)
+	{
+		auto shaderIdx = project.attachedShaders[i];
+		if (shaderIdx < project.shaderCount)
 		{
-			addError(mem, parser, hereStringLocation, ProjectErrorType::UnclosedHereString);
-			return false;
+			attached[shaderIdx] = true;
 		}
+	}
 
-		++parser.cursor;
+	for (u32 shaderIdx = 0; shaderIdx < project.shaderCount; ++shaderIdx)
+	{
+		if (attached[shaderIdx])
+		{
+			auto source = textRangeSlice(project.text, project.shaderSources[shaderIdx]);
+			checkGlslVersion(mem, parser, project.shaderTypes[shaderIdx], source);
+		}
+	}
+}
+
+/// Checks that the shaders attached to a program can be linked together: there
+/// is at most one shader of each type, and compute shaders are on their own.
+/// Attached shaders that are not resolved are skipped.
+static void checkProgramStages(
+	MemStack& mem, ProjectParser& parser, Project const& project, u32 programIdx, char *location)
+{
+	u32 stages = 0;
+	bool duplicateStage = false;
+	auto begin = project.programAttachments[programIdx];
+	auto end = project.programAttachments[programIdx + 1];
+	for (auto i = begin; i < end; ++i)
+	{
+		auto shaderIdx = project.attachedShaders[i];
+		if (shaderIdx >= project.shaderCount)
+		{
+			continue;
+		}
+		u32 stage = 1 << (u32) project.shaderTypes[shaderIdx];
+		duplicateStage = duplicateStage || (stages & stage) != 0;
+		stages |= stage;
+	}
+
+	if (duplicateStage)
+	{
+		addError(mem, parser, location, ProjectErrorType::ProgramDuplicateShaderStage);
+	}
+	u32 computeStage = 1 << (u32) ShaderType::Compute;
+	if ((stages & computeStage) != 0 && stages != computeStage)
+	{
+		addError(mem, parser, location, ProjectErrorType::ProgramMixesComputeAndGraphics);
 	}
 }
 
@@ -196,7 +668,7 @@ static bool parseShader(MemStack& mem, ProjectParser& parser, ShaderType shaderT
 	auto shaderToken = readToken(parser);
 	if (stringSliceLength(shaderToken.str) == 0)
 	{
-		addError(mem, parser, shaderToken.location, ProjectErrorType::ShaderMissingIdentifier);
+		addError(mem, parser, shaderToken.str.begin, ProjectErrorType::ShaderMissingIdentifier);
 		return false;
 	}
 	skipWhitespace(parser);
@@ -208,38 +680,183 @@ static bool parseShader(MemStack& mem, ProjectParser& parser, ShaderType shaderT
 	}
 	
 	auto shader = memStackPushType(mem, ShaderToken);
-	shader->location = shaderToken.location;
 	shader->identifier = shaderToken.str;
 	shader->type = shaderType;
 	shader->source = shaderSource;
+	shader->hash = shaderHash(shaderType, shaderSource);
 	shader->next = parser.shaders;
 	parser.shaders = shader;
 	++parser.shaderCount;
 	return true;
 }
 
-inline static void attachShaderToProgram(
-	MemStack& mem, ProjectParser& parser, ProgramToken& program, TextLocation identifierLocation)
+/// Converts one value of a buffer to its bits. Returns false, after adding an
+/// error, if the value is not a number of the element type.
+inline static bool parseBufferElement(
+	MemStack& mem, ProjectParser& parser, BufferElementType elementType, StringSlice str, u32& result)
 {
-	assert(identifierLocation.srcPtr != parser.cursor);
+	bool valid;
+	bool tooLarge;
+	switch (elementType)
+	{
+	case BufferElementType::F32:
+	{
+		f32 value = 0;
+		valid = parseF32(mem, str, value, tooLarge);
+		memcpy(&result, &value, sizeof(result));
+	} break;
+	case BufferElementType::U32:
+		valid = parseU32Base10(str, result, tooLarge);
+		break;
+	case BufferElementType::I32:
+	{
+		i32 value = 0;
+		valid = parseI32Base10(str, value, tooLarge);
+		result = (u32) value;
+	} break;
+	default:
+		unreachable();
+		return false;
+	}
 
-	auto shader = memStackPushType(mem, AttachedShaderToken);
-	shader->location = identifierLocation;
-	shader->identifier.begin = identifierLocation.srcPtr;
-	shader->identifier.end = parser.cursor;
-	++program.attachedShaderCount;
+	if (!valid)
+	{
+		addError(mem, parser, str.begin, ProjectErrorType::BufferInvalidValue);
+		return false;
+	}
+	if (tooLarge)
+	{
+		addError(mem, parser, str.begin, ProjectErrorType::BufferValueOutOfRange);
+		return false;
+	}
+	return true;
 }
 
-static bool parseProgram(MemStack& mem, ProjectParser& parser)
+/// Finds the next value at or after p, where values are separated by
+/// whitespace. Values are short, so one 16 byte load usually finds both where
+/// a value begins and where it ends. Returns false if there are no more values.
+inline static bool findNextValue(char *p, char *end, StringSlice& value)
+{
+	while (end - p >= 16)
+	{
+		auto chars = _mm_loadu_si128((__m128i*) p);
+		auto whitespace = whitespaceMask(chars, byteMask(chars, '\n'), byteMask(chars, '\r'));
+		auto nonWhitespace = ~whitespace & 0xFFFF;
+		if (nonWhitespace == 0)
+		{
+			p += 16;
+			continue;
+		}
+
+		auto valueBegin = countTrailingZeros(nonWhitespace);
+		auto whitespaceAfter = whitespace >> valueBegin;
+		value.begin = p + valueBegin;
+		value.end = whitespaceAfter != 0
+			? value.begin + countTrailingZeros(whitespaceAfter)
+			: findWhitespace(value.begin, end);
+		return true;
+	}
+
+	value.begin = skipWhitespace(p, end);
+	value.end = findWhitespace(value.begin, end);
+	return value.begin != end;
+}
+
+static bool parseBuffer(MemStack& mem, ProjectParser& parser)
+{
+	auto bufferToken = readToken(parser);
+	if (stringSliceLength(bufferToken.str) == 0)
+	{
+		addError(mem, parser, bufferToken.str.begin, ProjectErrorType::BufferMissingIdentifier);
+		return false;
+	}
+
+	auto elementTypeToken = readToken(parser);
+	BufferElementType elementType;
+	if (elementTypeToken.str == "f32")
+	{
+		elementType = BufferElementType::F32;
+	} else if (elementTypeToken.str == "u32")
+	{
+		elementType = BufferElementType::U32;
+	} else if (elementTypeToken.str == "i32")
+	{
+		elementType = BufferElementType::I32;
+	} else
+	{
+		addError(mem, parser, elementTypeToken.str.begin, ProjectErrorType::BufferUnknownElementType);
+		return false;
+	}
+	skipWhitespace(parser);
+
+	StringSlice valuesText = {};
+	if (!readHereString(mem, parser, valuesText))
+	{
+		return false;
+	}
+
+	// Values are separated by whitespace, so there can be at most one for every
+	// two characters. Room for that many is pushed, and what is not used is
+	// popped once the values are counted.
+	auto maxValueCount = (stringSliceLength(valuesText) + 1) / 2;
+	auto values = memStackPushArray(mem, u32, maxValueCount);
+	u32 valueCount = 0;
+	auto valid = true;
+	auto p = valuesText.begin;
+	StringSlice value;
+	while (findNextValue(p, valuesText.end, value))
+	{
+		// Every invalid value is reported, and the buffer is thrown away after
+		if (!parseBufferElement(mem, parser, elementType, value, values[valueCount]))
+		{
+			valid = false;
+			if (parser.errorCount >= maxProjectErrors)
+			{
+				return false;
+			}
+		}
+		++valueCount;
+		p = value.end;
+	}
+	if (!valid)
+	{
+		return false;
+	}
+	// "deallocate" the room for values that were not there
+	mem.top = (u8*) (values + valueCount);
+
+	auto buffer = memStackPushType(mem, BufferToken);
+	buffer->identifier = bufferToken.str;
+	buffer->elementType = elementType;
+	buffer->valueCount = valueCount;
+	buffer->values = values;
+	buffer->hash = hashBytes(values, valueCount * sizeof(u32), (u64) elementType);
+	buffer->next = parser.buffers;
+	parser.buffers = buffer;
+	++parser.bufferCount;
+	return true;
+}
+
+inline static void attachShaderToProgram(
+	MemStack& mem, ProjectParser& parser, ProgramToken& program, char *identifierBegin)
+{
+	assert(identifierBegin != parser.cursor);
+
+	auto shader = memStackPushType(mem, AttachedShaderToken);
+	shader->identifier.begin = identifierBegin;
+	shader->identifier.end = parser.cursor;
+	++program.attachedShaderCount;
+}
+
+static bool parseProgram(MemStack& mem, ProjectParser& parser)
 {
 	skipWhitespace(parser);
-	auto programLocation = parserTextLocation(parser);
+	auto programLocation = parser.cursor;
 
 	auto program = memStackPushType(mem, ProgramToken);
-	program->location = programLocation;
 	program->identifier = {};
 	program->attachedShaderCount = 0;
-	program->attachedShaders = (AttachedShaderToken*) mem.top;
+	program->attachedShaders = (AttachedShaderToken*) memStackAlign(mem, alignof(AttachedShaderToken));
 	program->next = parser.programs;
 	parser.programs = program;
 	++parser.programCount;
@@ -282,7 +899,6 @@ static bool parseProgram(MemStack& mem, ProjectParser& parser)
 	for (;;)
 	{
 		auto shaderIdentifierBegin = parser.cursor;
-		auto textLocation = parserTextLocation(parser);
 
 		for (;;)
 		{
@@ -299,7 +915,7 @@ static bool parseProgram(MemStack& mem, ProjectParser& parser)
 				// attached to the program.
 				if (parser.cursor != shaderIdentifierBegin)
 				{
-					attachShaderToProgram(mem, parser, *program, textLocation);
+					attachShaderToProgram(mem, parser, *program, shaderIdentifierBegin);
 				}
 				++parser.cursor;
 				return true;
@@ -307,7 +923,7 @@ static bool parseProgram(MemStack& mem, ProjectParser& parser)
 
 			if (isWhitespace(*parser.cursor))
 			{
-				attachShaderToProgram(mem, parser, *program, textLocation);
+				attachShaderToProgram(mem, parser, *program, shaderIdentifierBegin);
 				skipWhitespace(parser);
 				break;
 			}
@@ -317,286 +933,2385 @@ static bool parseProgram(MemStack& mem, ProjectParser& parser)
 	}
 }
 
-Project parseProject(MemStack& permMem, MemStack& scratchMem, StringSlice projectText, ProjectErrors& errors)
+static bool parseInclude(MemStack& mem, ProjectParser& parser)
 {
-	ProjectParser parser = {};
-	parser.cursor = projectText.begin;
-	parser.end = projectText.end;
-	parser.lineNumber = 1;
-	parser.lineBegin = projectText.begin;
-
-	Project project = {};
-
-	Version version;
+	skipWhitespace(parser);
+	auto includeLocation = parser.cursor;
+	if (parser.cursor == parser.end || *parser.cursor != '"')
 	{
-		auto versionToken = readToken(parser);
-		if (versionToken.str != "Version")
-		{
-			addError(scratchMem, parser, versionToken.location, ProjectErrorType::MissingVersionStatement);
-			goto returnResult;
-		}
+		addError(mem, parser, includeLocation, ProjectErrorType::IncludeMissingPath);
+		return false;
 	}
+	++parser.cursor;
+
+	// Paths are quoted so that they can contain spaces. They cannot span lines.
+	auto pathBegin = parser.cursor;
+	for (;;)
 	{
-		auto versionNumberToken = readToken(parser);
-		auto tokenLocation = versionNumberToken.location;
-		char *pDot = versionNumberToken.str.begin;
-		for (;;)
+		if (parser.cursor == parser.end || *parser.cursor == '\n' || *parser.cursor == '\r')
 		{
-			if (pDot == versionNumberToken.str.end)
-			{
-				addError(scratchMem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
-				goto returnResult;
-			}
-			
-			if (*pDot == '.')
-			{
-				break;
-			}
-			
-			++pDot;
+			addError(mem, parser, includeLocation, ProjectErrorType::IncludeUnclosedPath);
+			return false;
 		}
 
-		char *pFirstDot = pDot;
-
-		if (pFirstDot == versionNumberToken.str.begin)
+		if (*parser.cursor == '"')
 		{
-			addError(scratchMem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
-			goto returnResult;
-		}
-		if (pFirstDot + 1 == versionNumberToken.str.end)
-		{
-			addError(scratchMem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
-			goto returnResult;
+			break;
 		}
 
-		++pDot;
-		for (;;)
-		{
-			if (pDot == versionNumberToken.str.end)
-			{
-				break;
-			}
-			
-			if (*pDot == '.')
-			{
-				addError(scratchMem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
-				goto returnResult;
-			}
-			
-			++pDot;
-		}
+		++parser.cursor;
+	}
+	auto path = StringSlice{pathBegin, parser.cursor};
+	++parser.cursor;
+
+	if (stringSliceLength(path) == 0)
+	{
+		addError(mem, parser, includeLocation, ProjectErrorType::IncludeMissingPath);
+		return false;
+	}
+
+	auto include = memStackPushType(mem, IncludeToken);
+	include->offset = (u32) (includeLocation - parser.textBegin);
+	include->path = path;
+	include->next = parser.includes;
+	parser.includes = include;
+	++parser.includeCount;
+	return true;
+}
+
+/// Makes an empty name table with room for the given number of names
+static NameTable initNameTable(MemStack& mem, u32 maxNameCount)
+{
+	// keep the load factor at or below one half, so probe sequences stay short
+	u32 capacity = 16;
+	while (capacity < 2 * maxNameCount)
+	{
+		capacity *= 2;
+	}
+
+	NameTable result = {};
+	result.names = memStackPushArray(mem, TextRange, maxNameCount);
+	result.capacityMask = capacity - 1;
+	result.slots = memStackPushArray(mem, NameTableSlot, capacity);
+	memset(result.slots, 0, capacity * sizeof(NameTableSlot));
+	return result;
+}
+
+StringSlice textRangeSlice(StringSlice text, TextRange range)
+{
+	return StringSlice{text.begin + range.begin, text.begin + range.end};
+}
 
-		bool success = true;
-		auto majorStr = StringSlice{versionNumberToken.str.begin, pFirstDot};
-		if (!parseU32Base10(majorStr, version.major))
+inline static TextRange textRangeOf(StringSlice text, StringSlice str)
+{
+	return TextRange{(u32) (str.begin - text.begin), (u32) (str.end - text.begin)};
+}
+
+/// Finds the slot for a name. If the name is not in the table, this returns the
+/// empty slot where it belongs. The text is what the names in the table are
+/// ranges of.
+static NameTableSlot* findNameSlot(NameTable const& table, StringSlice text, StringSlice name, u32 hash)
+{
+	auto slotIdx = hash & table.capacityMask;
+	for (;;)
+	{
+		auto slot = table.slots + slotIdx;
+		if (slot->idPlusOne == 0
+			|| (slot->hash == hash && textRangeSlice(text, table.names[slot->idPlusOne - 1]) == name))
 		{
-			addError(scratchMem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
-			success = false;
+			return slot;
 		}
-		auto minorStr = StringSlice{pFirstDot + 1, versionNumberToken.str.end};
-		if (!parseU32Base10(minorStr, version.minor))
+		slotIdx = (slotIdx + 1) & table.capacityMask;
+	}
+}
+
+/// Returns the ID of a name, adding the name to the table if it is not there
+/// yet. The table must have room for it, and the name must be in the text.
+static u32 internName(NameTable& table, StringSlice text, StringSlice name)
+{
+	auto hash = (u32) hashStringSlice(name);
+	auto slot = findNameSlot(table, text, name, hash);
+	if (slot->idPlusOne == 0)
+	{
+		table.names[table.nameCount] = textRangeOf(text, name);
+		++table.nameCount;
+		slot->hash = hash;
+		slot->idPlusOne = table.nameCount;
+	}
+	return slot->idPlusOne - 1;
+}
+
+/// Returns the ID of a name, or invalidNameId if it is not in the table
+u32 findNameId(NameTable const& table, StringSlice text, StringSlice name)
+{
+	if (table.slots == nullptr)
+	{
+		return invalidNameId;
+	}
+	// an empty slot gives invalidNameId
+	auto slot = findNameSlot(table, text, name, (u32) hashStringSlice(name));
+	return slot->idPlusOne - 1;
+}
+
+static bool parseVersion(MemStack& mem, ProjectParser& parser, Version& version)
+{
+	auto versionToken = readToken(parser);
+	if (versionToken.str != "Version")
+	{
+		addError(mem, parser, versionToken.str.begin, ProjectErrorType::MissingVersionStatement);
+		return false;
+	}
+
+	auto versionNumberToken = readToken(parser);
+	auto tokenLocation = versionNumberToken.str.begin;
+	char *pDot = versionNumberToken.str.begin;
+	for (;;)
+	{
+		if (pDot == versionNumberToken.str.end)
 		{
-			addError(scratchMem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
-			success = false;
+			addError(mem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
+			return false;
 		}
-		if (!success)
+		
+		if (*pDot == '.')
 		{
-			goto returnResult;
+			break;
 		}
+		
+		++pDot;
+	}
 
-		if (!(version.major == 1 && version.minor == 0))
-		{
-			addError(scratchMem, parser, tokenLocation, ProjectErrorType::UnsupportedVersion);
-			goto returnResult;
-		}
+	char *pFirstDot = pDot;
+
+	if (pFirstDot == versionNumberToken.str.begin)
+	{
+		addError(mem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
+		return false;
+	}
+	if (pFirstDot + 1 == versionNumberToken.str.end)
+	{
+		addError(mem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
+		return false;
 	}
 
+	++pDot;
 	for (;;)
 	{
-		auto valueType = readToken(parser);
-		auto valueLocation = valueType.location;
-		if (stringSliceLength(valueType.str) == 0)
+		if (pDot == versionNumberToken.str.end)
 		{
-			// reached the end of input
 			break;
 		}
-
-		if (valueType.str == "VertexShader")
-		{
-			bool success = parseShader(scratchMem, parser, ShaderType::Vertex);
-			if (!success)
-			{
-				goto returnResult;
-			}
-		} else if (valueType.str == "TessControlShader")
-		{
-			bool success = parseShader(scratchMem, parser, ShaderType::TessControl);
-			if (!success)
-			{
-				goto returnResult;
-			}
-		} else if (valueType.str == "TessEvaluationShader")
-		{
-			bool success = parseShader(scratchMem, parser, ShaderType::TessEvaluation);
-			if (!success)
-			{
-				goto returnResult;
-			}
-		} else if (valueType.str == "GeometryShader")
-		{
-			bool success = parseShader(scratchMem, parser, ShaderType::Geometry);
-			if (!success)
-			{
-				goto returnResult;
-			}
-		} else if (valueType.str == "FragmentShader")
-		{
-			bool success = parseShader(scratchMem, parser, ShaderType::Fragment);
-			if (!success)
-			{
-				goto returnResult;
-			}
-		} else if (valueType.str == "ComputeShader")
-		{
-			bool success = parseShader(scratchMem, parser, ShaderType::Compute);
-			if (!success)
-			{
-				goto returnResult;
-			}
-		} else if (valueType.str == "Program")
-		{
-			bool success = parseProgram(scratchMem, parser);
-			if (!success)
-			{
-				goto returnResult;
-			}
-		} else
+		
+		if (*pDot == '.')
 		{
-			addError(scratchMem, parser, valueLocation, ProjectErrorType::UnknownValueType);
-			goto returnResult;
+			addError(mem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
+			return false;
 		}
+		
+		++pDot;
 	}
 
-	project.version = version;
+	bool success = true;
+	auto majorStr = StringSlice{versionNumberToken.str.begin, pFirstDot};
+	if (!parseU32Base10(majorStr, version.major))
+	{
+		addError(mem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
+		success = false;
+	}
+	auto minorStr = StringSlice{pFirstDot + 1, versionNumberToken.str.end};
+	if (!parseU32Base10(minorStr, version.minor))
+	{
+		addError(mem, parser, tokenLocation, ProjectErrorType::VersionInvalidFormat);
+		success = false;
+	}
+	if (!success)
+	{
+		return false;
+	}
 
-	// Copy the shaders and programs to permanent storage. Copying is done
-	// in reverse order so that arrays are in the same order as in the file.
+	if (!(version.major == 1 && version.minor == 0))
+	{
+		addError(mem, parser, tokenLocation, ProjectErrorType::UnsupportedVersion);
+		return false;
+	}
 
-//TODO consider using a temporary hashmap to do name lookups. Project files may
-// never get large enough to justify this complexity, but if the loading process
-// gets sluggish, this is something to consider.
+	return true;
+}
 
-	auto projectMemMarker = memStackMark(permMem);
+/// Parses the declaration at the cursor. The cursor must not be at whitespace
+/// or at the end of the text.
+static bool parseShaderValue(MemStack& mem, ProjectParser& parser, ValueType const& valueType)
+{
+	return parseShader(mem, parser, valueType.shaderType);
+}
 
-	project.shaders = memStackPushArray(permMem, Shader, parser.shaderCount);
-	project.shaderCount = parser.shaderCount;
-	{
-		auto pShader = parser.shaders;
-		auto shaderIdx = parser.shaderCount - 1;
-		while (pShader != nullptr)
-		{
-			project.shaders[shaderIdx].type = pShader->type;
-			project.shaders[shaderIdx].name = packString(permMem, pShader->identifier);
-			project.shaders[shaderIdx].source = packString(permMem, pShader->source);
+static bool parseProgramValue(MemStack& mem, ProjectParser& parser, ValueType const&)
+{
+	return parseProgram(mem, parser);
+}
 
-			// check the shader name for uniqueness
-			for (auto i = shaderIdx + 1; i < project.shaderCount; ++i)
-			{
-				if (unpackString(project.shaders[i].name) == pShader->identifier)
-				{
-					addError(scratchMem, parser, pShader->location, ProjectErrorType::DuplicateShaderName);
-					break;
-				}
-			}
+static bool parseIncludeValue(MemStack& mem, ProjectParser& parser, ValueType const&)
+{
+	return parseInclude(mem, parser);
+}
 
-			pShader = pShader->next;
-			--shaderIdx;
-		}
-	}
+static bool parseBufferValue(MemStack& mem, ProjectParser& parser, ValueType const&)
+{
+	return parseBuffer(mem, parser);
+}
 
-	project.programCount = parser.programCount;
-	project.programs = memStackPushArray(permMem, Program, parser.programCount);
+/// Every kind of declaration in a project. New kinds of declarations are added here.
+static const ValueType valueTypes[] = {
+	{"VertexShader", DeclarationType::Shader, ShaderType::Vertex, parseShaderValue},
+	{"TessControlShader", DeclarationType::Shader, ShaderType::TessControl, parseShaderValue},
+	{"TessEvaluationShader", DeclarationType::Shader, ShaderType::TessEvaluation, parseShaderValue},
+	{"GeometryShader", DeclarationType::Shader, ShaderType::Geometry, parseShaderValue},
+	{"FragmentShader", DeclarationType::Shader, ShaderType::Fragment, parseShaderValue},
+	{"ComputeShader", DeclarationType::Shader, ShaderType::Compute, parseShaderValue},
+	{"Program", DeclarationType::Program, ShaderType::Vertex, parseProgramValue},
+	{"Include", DeclarationType::Include, ShaderType::Vertex, parseIncludeValue},
+	{"Buffer", DeclarationType::Buffer, ShaderType::Vertex, parseBufferValue},
+};
+
+/// Maps value type keywords to entries of the value type array, hashed by their
+/// length and first character, which tells all the keywords apart. Each slot
+/// holds an index into the value type array plus one, or zero if it is empty.
+static const u32 valueTypeSlotCount = 32;
+
+struct ValueTypeTable
+{
+	u8 slots[valueTypeSlotCount];
+};
+
+inline static u32 valueTypeSlot(size_t length, char firstChar)
+{
+	return (u32) (length * 7 + (u8) firstChar) & (valueTypeSlotCount - 1);
+}
+
+static ValueTypeTable buildValueTypeTable()
+{
+	ValueTypeTable table = {};
+	for (u32 i = 0; i < arrayLength(valueTypes); ++i)
 	{
-		auto pProgram = parser.programs;
-		auto programIdx = parser.programCount - 1;
-		while (pProgram != nullptr)
+		auto keyword = valueTypes[i].keyword;
+		auto slot = valueTypeSlot(cStringLength((char*) keyword), keyword[0]);
+		while (table.slots[slot] != 0)
 		{
-			project.programs[programIdx].name = packString(permMem, pProgram->identifier);
-			if (pProgram->attachedShaderCount > 255)
-			{
-				addError(
-					scratchMem,
-					parser,
-					pProgram->location,
-					ProjectErrorType::ProgramExceedsAttachedShaderLimit);
-				project.programs[programIdx].attachedShaderCount = 0;
-				project.programs[programIdx].attachedShaders = nullptr;
-				continue;
-			}
-			
-			// check the program name for uniqueness
-			for (auto i = programIdx + 1; i < project.programCount; ++i)
-			{
-				if (unpackString(project.programs[i].name) == pProgram->identifier)
-				{
-					addError(scratchMem, parser, pProgram->location, ProjectErrorType::DuplicateProgramName);
-					break;
-				}
-			}
-
-			auto shaderListLength = pProgram->attachedShaderCount;
-			project.programs[programIdx].attachedShaderCount = (u8) shaderListLength;
-			project.programs[programIdx].attachedShaders = memStackPushArray(permMem, Shader*, shaderListLength);
+			slot = (slot + 1) & (valueTypeSlotCount - 1);
+		}
+		table.slots[slot] = (u8) (i + 1);
+	}
+	return table;
+}
 
-			// lookup pointers to attached shaders
-			for (u32 shaderIdx = 0; shaderIdx < shaderListLength; ++shaderIdx)
-			{
-				auto shader = pProgram->attachedShaders[shaderIdx];
-				for (u32 i = 0; i < project.shaderCount; ++i)
-				{
-					if (unpackString(project.shaders[i].name) == shader.identifier)
-					{
-						project.programs[programIdx].attachedShaders[shaderIdx] = project.shaders + i;
-						goto LBL_nextShader;
-					}
-				}
-				project.programs[programIdx].attachedShaders[shaderIdx] = nullptr;
-				addError(
-					scratchMem,
-					parser,
-					shader.location,
-					ProjectErrorType::ProgramUnresolvedShaderIdent);
-				LBL_nextShader:;
-			}
+/// Returns the value type a keyword names, or null if it is not a value type keyword
+static ValueType const* findValueType(StringSlice keyword)
+{
+	// Built on first use. Initialization of a local static is thread safe, and
+	// this is called from parse jobs that run in parallel.
+	static const ValueTypeTable table = buildValueTypeTable();
 
-			pProgram = pProgram->next;
-			--programIdx;
+	auto length = stringSliceLength(keyword);
+	if (length == 0)
+	{
+		return nullptr;
+	}
+	auto slot = valueTypeSlot(length, keyword.begin[0]);
+	while (table.slots[slot] != 0)
+	{
+		auto valueType = &valueTypes[table.slots[slot] - 1];
+		if (keyword == valueType->keyword)
+		{
+			return valueType;
 		}
+		slot = (slot + 1) & (valueTypeSlotCount - 1);
 	}
+	return nullptr;
+}
 
+static bool parseDeclaration(MemStack& mem, ProjectParser& parser)
+{
+	auto valueTypeToken = readToken(parser);
+	auto valueLocation = valueTypeToken.str.begin;
+	assert(stringSliceLength(valueTypeToken.str) != 0);
 
-	if (parser.errorCount == 0)
+	auto valueType = findValueType(valueTypeToken.str);
+	if (valueType == nullptr)
 	{
-		errors = {};
-		return project;
+		addError(mem, parser, valueLocation, ProjectErrorType::UnknownValueType);
+		return false;
 	}
 
-	memStackPop(permMem, projectMemMarker);
-	project = {};
-	
-returnResult:
-	errors.count = parser.errorCount;
-	errors.ptr = memStackPushArray(permMem, ProjectError, parser.errorCount);
-	auto pError = parser.errors;
-	u32 i = 0;
-	while (pError != nullptr)
+	if (!valueType->parse(mem, parser, *valueType))
 	{
-		 errors.ptr[i].type = pError->type;
-		 errors.ptr[i].location = pError->location;
-		 pError = pError->next;
-		 ++i;
+		return false;
 	}
 
-	return project;
+	auto declaration = memStackPushType(mem, DeclarationToken);
+	declaration->type = valueType->declarationType;
+	declaration->text = StringSlice{valueLocation, parser.cursor};
+	declaration->next = parser.declarations;
+	parser.declarations = declaration;
+	++parser.declarationCount;
+	return true;
 }
 
+/// Finds the first line after the one containing p that begins with a value
+/// type keyword followed by whitespace, and returns a pointer to the keyword.
+/// This is only a guess at where a declaration begins, because the line may be
+/// in the middle of a here string.
+static char* findDeclarationStart(char *p, char *end)
+{
+	for (;;)
+	{
+		while (end - p >= 16)
+		{
+			auto chars = _mm_loadu_si128((__m128i*) p);
+			auto newlines = byteMask(chars, '\n') | byteMask(chars, '\r');
+			if (newlines != 0)
+			{
+				p += countTrailingZeros(newlines);
+				break;
+			}
+			p += 16;
+		}
+		while (p != end && *p != '\n' && *p != '\r')
+		{
+			++p;
+		}
+
+		while (p != end && isWhitespace(*p))
+		{
+			++p;
+		}
+		auto tokenEnd = p;
+		while (tokenEnd != end && !isWhitespace(*tokenEnd))
+		{
+			++tokenEnd;
+		}
+		if (tokenEnd == end)
+		{
+			return end;
+		}
+		if (findValueType(StringSlice{p, tokenEnd}) != nullptr)
+		{
+			return p;
+		}
+		p = tokenEnd;
+	}
+}
+
+/// Moves the parser past a declaration that failed to parse, to the next line
+/// that begins with a value type keyword. Anything the declaration added before
+/// it failed is thrown away, so that only complete declarations are built into
+/// the project. The errors it added are kept.
+static void skipFailedDeclaration(ProjectParser& parser, ProjectParser const& declarationStart)
+{
+	auto resumePtr = findDeclarationStart(declarationStart.cursor, parser.end);
+
+	parser.shaderCount = declarationStart.shaderCount;
+	parser.shaders = declarationStart.shaders;
+	parser.programCount = declarationStart.programCount;
+	parser.programs = declarationStart.programs;
+	parser.includeCount = declarationStart.includeCount;
+	parser.includes = declarationStart.includes;
+	parser.bufferCount = declarationStart.bufferCount;
+	parser.buffers = declarationStart.buffers;
+
+	parser.cursor = resumePtr;
+}
+
+/// Parses declarations until the end of the text, or until the cursor is at
+/// or past the stop pointer when a declaration would begin. A declaration that
+/// fails to parse is skipped, so that all errors are found in one pass. Returns
+/// false if parsing stopped early because there were too many errors.
+static bool parseDeclarations(MemStack& mem, ProjectParser& parser, char *stop)
+{
+	for (;;)
+	{
+		skipWhitespace(parser);
+		if (parser.cursor == parser.end || parser.cursor >= stop)
+		{
+			return true;
+		}
+
+		auto declarationStart = parser;
+		if (!parseDeclaration(mem, parser))
+		{
+			if (parser.errorCount >= maxProjectErrors)
+			{
+				return false;
+			}
+			skipFailedDeclaration(parser, declarationStart);
+		}
+	}
+}
+
+/// Moves a range of a previous project's text to where the same characters are
+/// in the new text. The offset accounts for text that was inserted or removed
+/// before the range.
+inline static TextRange rebaseRange(TextRange range, i64 offset)
+{
+	return TextRange{(u32) (range.begin + offset), (u32) (range.end + offset)};
+}
+
+/// Copies a shader of another project, moving its ranges of text by the offset.
+/// The name ID is not copied, because it belongs to the other project's name table.
+inline static void rebaseShader(
+	Project& project, u32 shaderIdx, Project const& other, u32 otherShaderIdx, i64 offset)
+{
+	project.shaderTypes[shaderIdx] = other.shaderTypes[otherShaderIdx];
+	project.shaderNames[shaderIdx] = rebaseRange(other.shaderNames[otherShaderIdx], offset);
+	project.shaderSources[shaderIdx] = rebaseRange(other.shaderSources[otherShaderIdx], offset);
+	project.shaderHashes[shaderIdx] = other.shaderHashes[otherShaderIdx];
+}
+
+/// Copies a buffer of another project, and its values, moving its name by the
+/// offset. The values are put at the given index of this project's values, and
+/// the number of them is returned. Like with shaders, the name ID is not copied.
+inline static u32 rebaseBuffer(
+	Project& project, u32 bufferIdx, u32 valuesBegin, Project const& other, u32 otherBufferIdx, i64 offset)
+{
+	project.bufferElementTypes[bufferIdx] = other.bufferElementTypes[otherBufferIdx];
+	project.bufferNames[bufferIdx] = rebaseRange(other.bufferNames[otherBufferIdx], offset);
+	project.bufferHashes[bufferIdx] = other.bufferHashes[otherBufferIdx];
+	project.bufferValueOffsets[bufferIdx] = valuesBegin;
+	auto otherValuesBegin = other.bufferValueOffsets[otherBufferIdx];
+	auto valueCount = other.bufferValueOffsets[otherBufferIdx + 1] - otherValuesBegin;
+	memcpy(project.bufferValues + valuesBegin, other.bufferValues + otherValuesBegin, valueCount * sizeof(u32));
+	return valueCount;
+}
+
+/// Builds the reverse index from shaders to the programs that attach them
+static void buildShaderProgramIndex(MemStack& mem, Project& project)
+{
+	// A program that attaches a shader more than once is listed once for it.
+	// Programs are walked in order, and the last program seen attaching each
+	// shader is kept, so an attachment repeats one of the current program when
+	// the shader's last program is the current one. They start out as all ones,
+	// which is not the index of any program.
+
+	// The offsets array first holds the number of programs that attach each
+	// shader, shifted by one, so that a prefix sum turns counts into offsets.
+	auto offsets = memStackPushArray(mem, u32, project.shaderCount + 1);
+	memset(offsets, 0, (project.shaderCount + 1) * sizeof(u32));
+	auto memMarker = memStackMark(mem);
+	auto lastPrograms = memStackPushArray(mem, u32, project.shaderCount);
+	memset(lastPrograms, 0xFF, project.shaderCount * sizeof(u32));
+	// Attached shaders that are not in the shader array, because they did not
+	// resolve or are in another file, are left out
+	for (u32 programIdx = 0; programIdx < project.programCount; ++programIdx)
+	{
+		auto end = project.programAttachments[programIdx + 1];
+		for (auto i = project.programAttachments[programIdx]; i < end; ++i)
+		{
+			auto shaderIdx = project.attachedShaders[i];
+			if (shaderIdx < project.shaderCount && lastPrograms[shaderIdx] != programIdx)
+			{
+				lastPrograms[shaderIdx] = programIdx;
+				++offsets[shaderIdx + 1];
+			}
+		}
+	}
+	memStackPop(mem, memMarker);
+	for (u32 i = 0; i < project.shaderCount; ++i)
+	{
+		offsets[i + 1] += offsets[i];
+	}
+
+	// The next free slot of each shader starts at its offset. The slots are
+	// only needed while the index is filled, so they are popped afterwards.
+	auto programs = memStackPushArray(mem, u32, offsets[project.shaderCount]);
+	memMarker = memStackMark(mem);
+	auto nextSlots = memStackPushArray(mem, u32, project.shaderCount);
+	memcpy(nextSlots, offsets, project.shaderCount * sizeof(u32));
+	lastPrograms = memStackPushArray(mem, u32, project.shaderCount);
+	memset(lastPrograms, 0xFF, project.shaderCount * sizeof(u32));
+	for (u32 programIdx = 0; programIdx < project.programCount; ++programIdx)
+	{
+		auto end = project.programAttachments[programIdx + 1];
+		for (auto i = project.programAttachments[programIdx]; i < end; ++i)
+		{
+			auto shaderIdx = project.attachedShaders[i];
+			if (shaderIdx < project.shaderCount && lastPrograms[shaderIdx] != programIdx)
+			{
+				lastPrograms[shaderIdx] = programIdx;
+				auto& slot = nextSlots[shaderIdx];
+				programs[slot] = programIdx;
+				++slot;
+			}
+		}
+	}
+	memStackPop(mem, memMarker);
+
+	project.shaderProgramOffsets = offsets;
+	project.shaderPrograms = programs;
+}
+
+/// Finds the programs that attach any of the given shaders, which are the ones
+/// to relink when those shaders change. Each program is found once, and the
+/// work done is proportional to the number of programs found. The indices of
+/// the programs are pushed to the memory stack, and the count is returned. An
+/// incremental parse uses this to find the programs whose hashes change with
+/// the shaders it parsed again, and a changed hash is what relinks a program.
+u32 findProgramsAttachingShaders(
+	MemStack& mem,
+	Project const& project,
+	u32 const *shaderIndices,
+	u32 shaderCount,
+	u32*& programIndices)
+{
+	u32 candidateCount = 0;
+	for (u32 i = 0; i < shaderCount; ++i)
+	{
+		auto shaderIdx = shaderIndices[i];
+		candidateCount +=
+			project.shaderProgramOffsets[shaderIdx + 1] - project.shaderProgramOffsets[shaderIdx];
+	}
+
+	programIndices = memStackPushArray(mem, u32, candidateCount);
+	auto memMarker = memStackMark(mem);
+
+	// A set of the programs found so far. Slots hold a program index plus one,
+	// or zero if they are empty, and the load factor is at most one half.
+	u32 capacity = 16;
+	while (capacity < 2 * candidateCount)
+	{
+		capacity *= 2;
+	}
+	auto foundPrograms = memStackPushArray(mem, u32, capacity);
+	memset(foundPrograms, 0, capacity * sizeof(u32));
+
+	u32 programCount = 0;
+	for (u32 i = 0; i < shaderCount; ++i)
+	{
+		auto shaderIdx = shaderIndices[i];
+		auto begin = project.shaderProgramOffsets[shaderIdx];
+		auto end = project.shaderProgramOffsets[shaderIdx + 1];
+		for (auto j = begin; j < end; ++j)
+		{
+			auto programIdx = project.shaderPrograms[j];
+			auto slot = (programIdx * 0x9E3779B1u) & (capacity - 1);
+			while (foundPrograms[slot] != 0 && foundPrograms[slot] != programIdx + 1)
+			{
+				slot = (slot + 1) & (capacity - 1);
+			}
+			if (foundPrograms[slot] == 0)
+			{
+				foundPrograms[slot] = programIdx + 1;
+				programIndices[programCount] = programIdx;
+				++programCount;
+			}
+		}
+	}
+
+	memStackPop(mem, memMarker);
+	return programCount;
+}
+
+/// Reads the next shader identifier of a program's shader list, from where the
+/// previous identifier ended. The list must be closed.
+static StringSlice readAttachedShaderIdentifier(char*& cursor)
+{
+	while (isWhitespace(*cursor))
+	{
+		++cursor;
+	}
+	auto begin = cursor;
+	while (*cursor != '}' && !isWhitespace(*cursor))
+	{
+		++cursor;
+	}
+	return StringSlice{begin, cursor};
+}
+
+/// Builds a project from the parsed declarations and the reused declarations of
+/// a previous project, and resolves the names of attached shaders. Errors are
+/// added to the parser. With external shaders allowed, a name that does not
+/// resolve is assumed to be declared in another file, and gets a placeholder
+/// shader until the project is linked.
+static Project buildProject(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	ProjectParser& parser,
+	StringSlice projectText,
+	ReusedDeclarations const& reuse,
+	bool externalShaders)
+{
+	auto previous = reuse.previous;
+	u32 suffixDeclarationCount = 0;
+	u32 suffixShaderCount = 0;
+	u32 suffixProgramCount = 0;
+	u32 suffixBufferCount = 0;
+	u32 suffixIncludeCount = 0;
+	if (previous != nullptr)
+	{
+		suffixDeclarationCount = previous->declarationCount - reuse.suffixDeclarationIdx;
+		suffixShaderCount = previous->shaderCount - reuse.suffixShaderIdx;
+		suffixProgramCount = previous->programCount - reuse.suffixProgramIdx;
+		suffixBufferCount = previous->bufferCount - reuse.suffixBufferIdx;
+		suffixIncludeCount = previous->includeCount - reuse.suffixIncludeIdx;
+	}
+
+	Project project = {};
+	project.text = projectText;
+
+	// The parsed declarations, shaders, and programs are in linked lists, in
+	// reverse order. They are copied in reverse so that arrays are in the same
+	// order as in the file.
+
+	// The paths of reused includes point into the previous text, so they are
+	// moved to the same place in the new text
+	project.includeCount = reuse.prefixIncludeCount + parser.includeCount + suffixIncludeCount;
+	project.includes = memStackPushArray(permMem, Include, project.includeCount);
+	for (u32 i = 0; i < reuse.prefixIncludeCount; ++i)
+	{
+		auto const& include = previous->includes[i];
+		auto pathBegin = projectText.begin + (include.path.begin - previous->text.begin);
+		project.includes[i].path = StringSlice{pathBegin, pathBegin + stringSliceLength(include.path)};
+		project.includes[i].offset = include.offset;
+	}
+	{
+		auto pInclude = parser.includes;
+		auto includeIdx = reuse.prefixIncludeCount + parser.includeCount;
+		while (pInclude != nullptr)
+		{
+			--includeIdx;
+			project.includes[includeIdx].path = pInclude->path;
+			project.includes[includeIdx].offset = pInclude->offset;
+			pInclude = pInclude->next;
+		}
+	}
+	for (u32 i = 0; i < suffixIncludeCount; ++i)
+	{
+		auto const& include = previous->includes[reuse.suffixIncludeIdx + i];
+		auto pathBegin = projectText.begin + (include.path.begin - previous->text.begin) + reuse.suffixOffset;
+		auto& suffixInclude = project.includes[project.includeCount - suffixIncludeCount + i];
+		suffixInclude.path = StringSlice{pathBegin, pathBegin + stringSliceLength(include.path)};
+		suffixInclude.offset = (u32) (include.offset + reuse.suffixOffset);
+	}
+
+	project.declarationCount =
+		reuse.prefixDeclarationCount + parser.declarationCount + suffixDeclarationCount;
+	project.declarations = memStackPushArray(permMem, Declaration, project.declarationCount);
+	{
+		auto declarations = project.declarations;
+		for (u32 i = 0; i < reuse.prefixDeclarationCount; ++i)
+		{
+			declarations[i] = previous->declarations[i];
+		}
+
+		declarations += reuse.prefixDeclarationCount;
+		auto pDeclaration = parser.declarations;
+		auto declarationIdx = parser.declarationCount;
+		while (pDeclaration != nullptr)
+		{
+			--declarationIdx;
+			declarations[declarationIdx].type = pDeclaration->type;
+			declarations[declarationIdx].begin = (u32) (pDeclaration->text.begin - projectText.begin);
+			declarations[declarationIdx].end = (u32) (pDeclaration->text.end - projectText.begin);
+			pDeclaration = pDeclaration->next;
+		}
+
+		declarations += parser.declarationCount;
+		for (u32 i = 0; i < suffixDeclarationCount; ++i)
+		{
+			auto declaration = previous->declarations[reuse.suffixDeclarationIdx + i];
+			declaration.begin = (u32) (declaration.begin + reuse.suffixOffset);
+			declaration.end = (u32) (declaration.end + reuse.suffixOffset);
+			declarations[i] = declaration;
+		}
+	}
+
+	// Errors about reused shaders and programs are reported at their declarations,
+	// which is fine because an incremental parse with errors is redone in full,
+	// so these locations are never reported.
+	project.shaderCount = reuse.prefixShaderCount + parser.shaderCount + suffixShaderCount;
+	project.shaderTypes = memStackPushArray(permMem, ShaderType, project.shaderCount);
+	project.shaderNames = memStackPushArray(permMem, TextRange, project.shaderCount);
+	project.shaderNameIds = memStackPushArray(permMem, u32, project.shaderCount);
+	project.shaderSources = memStackPushArray(permMem, TextRange, project.shaderCount);
+	project.shaderHashes = memStackPushArray(permMem, u64, project.shaderCount);
+	auto shaderLocations = memStackPushArray(scratchMem, char*, project.shaderCount);
+	project.programCount = reuse.prefixProgramCount + parser.programCount + suffixProgramCount;
+	project.programNames = memStackPushArray(permMem, TextRange, project.programCount);
+	project.programNameIds = memStackPushArray(permMem, u32, project.programCount);
+	project.programAttachments = memStackPushArray(permMem, u32, project.programCount + 1);
+	project.programHashes = memStackPushArray(permMem, u64, project.programCount);
+	auto programLocations = memStackPushArray(scratchMem, char*, project.programCount);
+	{
+		u32 shaderIdx = 0;
+		u32 programIdx = 0;
+		for (u32 i = 0; i < project.declarationCount; ++i)
+		{
+			auto location = projectText.begin + project.declarations[i].begin;
+			switch (project.declarations[i].type)
+			{
+			case DeclarationType::Shader:
+				shaderLocations[shaderIdx] = location;
+				++shaderIdx;
+				break;
+			case DeclarationType::Program:
+				programLocations[programIdx] = location;
+				++programIdx;
+				break;
+			case DeclarationType::Include:
+			case DeclarationType::Buffer:
+				break;
+			}
+		}
+	}
+
+	// Names are interned once every shader and program is known, because the
+	// table needs to know how many names there are
+	for (u32 i = 0; i < reuse.prefixShaderCount; ++i)
+	{
+		rebaseShader(project, i, *previous, i, 0);
+	}
+	{
+		auto pShader = parser.shaders;
+		auto shaderIdx = reuse.prefixShaderCount + parser.shaderCount;
+		while (pShader != nullptr)
+		{
+			--shaderIdx;
+			project.shaderTypes[shaderIdx] = pShader->type;
+			project.shaderNames[shaderIdx] = textRangeOf(projectText, pShader->identifier);
+			project.shaderSources[shaderIdx] = textRangeOf(projectText, pShader->source);
+			project.shaderHashes[shaderIdx] = pShader->hash;
+			shaderLocations[shaderIdx] = pShader->identifier.begin;
+			pShader = pShader->next;
+		}
+	}
+	for (u32 i = 0; i < suffixShaderCount; ++i)
+	{
+		auto shaderIdx = project.shaderCount - suffixShaderCount + i;
+		rebaseShader(project, shaderIdx, *previous, reuse.suffixShaderIdx + i, reuse.suffixOffset);
+	}
+
+	// Parsed buffers are walked from the end of the list, so their values are
+	// filled from the end of the parsed values
+	project.bufferCount = reuse.prefixBufferCount + parser.bufferCount + suffixBufferCount;
+	project.bufferElementTypes = memStackPushArray(permMem, BufferElementType, project.bufferCount);
+	project.bufferNames = memStackPushArray(permMem, TextRange, project.bufferCount);
+	project.bufferNameIds = memStackPushArray(permMem, u32, project.bufferCount);
+	project.bufferValueOffsets = memStackPushArray(permMem, u32, project.bufferCount + 1);
+	project.bufferHashes = memStackPushArray(permMem, u64, project.bufferCount);
+	{
+		u32 prefixValueCount = 0;
+		u32 suffixValueCount = 0;
+		if (previous != nullptr)
+		{
+			prefixValueCount = previous->bufferValueOffsets[reuse.prefixBufferCount];
+			suffixValueCount = previous->bufferValueCount - previous->bufferValueOffsets[reuse.suffixBufferIdx];
+		}
+		project.bufferValueCount = prefixValueCount + suffixValueCount;
+		for (auto pBuffer = parser.buffers; pBuffer != nullptr; pBuffer = pBuffer->next)
+		{
+			project.bufferValueCount += pBuffer->valueCount;
+		}
+		project.bufferValues = memStackPushArray(permMem, u32, project.bufferValueCount);
+		project.bufferValueOffsets[project.bufferCount] = project.bufferValueCount;
+
+		u32 valuesBegin = 0;
+		for (u32 i = 0; i < reuse.prefixBufferCount; ++i)
+		{
+			valuesBegin += rebaseBuffer(project, i, valuesBegin, *previous, i, 0);
+		}
+
+		auto valuesEnd = project.bufferValueCount - suffixValueCount;
+		auto pBuffer = parser.buffers;
+		auto bufferIdx = reuse.prefixBufferCount + parser.bufferCount;
+		while (pBuffer != nullptr)
+		{
+			--bufferIdx;
+			valuesEnd -= pBuffer->valueCount;
+			project.bufferElementTypes[bufferIdx] = pBuffer->elementType;
+			project.bufferNames[bufferIdx] = textRangeOf(projectText, pBuffer->identifier);
+			project.bufferHashes[bufferIdx] = pBuffer->hash;
+			project.bufferValueOffsets[bufferIdx] = valuesEnd;
+			memcpy(project.bufferValues + valuesEnd, pBuffer->values, pBuffer->valueCount * sizeof(u32));
+			pBuffer = pBuffer->next;
+		}
+
+		valuesBegin = project.bufferValueCount - suffixValueCount;
+		for (u32 i = 0; i < suffixBufferCount; ++i)
+		{
+			auto bufferIdx = project.bufferCount - suffixBufferCount + i;
+			valuesBegin += rebaseBuffer(
+				project, bufferIdx, valuesBegin, *previous, reuse.suffixBufferIdx + i, reuse.suffixOffset);
+		}
+	}
+
+	auto maxNameCount = project.shaderCount + project.programCount + project.bufferCount;
+	if (externalShaders)
+	{
+		// Shaders declared in other files have names too
+		for (auto pProgram = parser.programs; pProgram != nullptr; pProgram = pProgram->next)
+		{
+			maxNameCount += pProgram->attachedShaderCount;
+		}
+		if (previous != nullptr)
+		{
+			auto previousAttachments = previous->programAttachments;
+			maxNameCount += previousAttachments[reuse.prefixProgramCount]
+				+ previousAttachments[previous->programCount] - previousAttachments[reuse.suffixProgramIdx];
+		}
+	}
+	project.names = initNameTable(permMem, maxNameCount);
+	for (u32 shaderIdx = 0; shaderIdx < project.shaderCount; ++shaderIdx)
+	{
+		auto name = textRangeSlice(projectText, project.shaderNames[shaderIdx]);
+		project.shaderNameIds[shaderIdx] = internName(project.names, projectText, name);
+	}
+
+	for (u32 bufferIdx = 0; bufferIdx < project.bufferCount; ++bufferIdx)
+	{
+		auto name = textRangeSlice(projectText, project.bufferNames[bufferIdx]);
+		project.bufferNameIds[bufferIdx] = internName(project.names, projectText, name);
+	}
+
+	// The index of the shader, program, and buffer with each name, plus one, or
+	// zero if there is none
+	auto shaderByName = memStackPushArray(scratchMem, u32, maxNameCount);
+	memset(shaderByName, 0, maxNameCount * sizeof(u32));
+	auto programByName = memStackPushArray(scratchMem, u32, maxNameCount);
+	memset(programByName, 0, maxNameCount * sizeof(u32));
+	auto bufferByName = memStackPushArray(scratchMem, u32, maxNameCount);
+	memset(bufferByName, 0, maxNameCount * sizeof(u32));
+	for (u32 bufferIdx = project.bufferCount; bufferIdx-- > 0; )
+	{
+		auto nameId = project.bufferNameIds[bufferIdx];
+		if (bufferByName[nameId] != 0)
+		{
+			auto location = projectText.begin + project.bufferNames[bufferIdx].begin;
+			addError(scratchMem, parser, location, ProjectErrorType::DuplicateBufferName);
+		}
+		bufferByName[nameId] = bufferIdx + 1;
+	}
+
+	for (u32 shaderIdx = project.shaderCount; shaderIdx-- > 0; )
+	{
+		// Shaders later in the file have already been seen, so finding the name
+		// means it is not unique. The entry is overwritten either way, so that
+		// names resolve to the first shader in the file with this name.
+		auto nameId = project.shaderNameIds[shaderIdx];
+		if (shaderByName[nameId] != 0)
+		{
+			addError(scratchMem, parser, shaderLocations[shaderIdx], ProjectErrorType::DuplicateShaderName);
+		}
+		shaderByName[nameId] = shaderIdx + 1;
+	}
+
+	// Programs are walked last to first, so the attached shader array is filled
+	// from its end, which needs its size up front
+	auto parsedProgramsBegin = reuse.prefixProgramCount;
+	auto parsedProgramsEnd = parsedProgramsBegin + parser.programCount;
+	if (previous != nullptr)
+	{
+		auto previousAttachments = previous->programAttachments;
+		project.attachedShaderCount = previousAttachments[reuse.prefixProgramCount]
+			+ previousAttachments[previous->programCount] - previousAttachments[reuse.suffixProgramIdx];
+	}
+	for (auto pProgram = parser.programs; pProgram != nullptr; pProgram = pProgram->next)
+	{
+		if (pProgram->attachedShaderCount <= 255)
+		{
+			project.attachedShaderCount += pProgram->attachedShaderCount;
+		}
+	}
+	project.attachedShaders = memStackPushArray(permMem, u32, project.attachedShaderCount);
+	project.programAttachments[project.programCount] = project.attachedShaderCount;
+
+	auto attachmentsEnd = project.attachedShaderCount;
+	auto pProgram = parser.programs;
+	for (u32 programIdx = project.programCount; programIdx-- > 0; )
+	{
+		auto parsed = programIdx >= parsedProgramsBegin && programIdx < parsedProgramsEnd;
+		auto reusedIdx = programIdx < parsedProgramsBegin
+			? programIdx
+			: programIdx - parsedProgramsEnd + reuse.suffixProgramIdx;
+		if (parsed)
+		{
+			project.programNames[programIdx] = textRangeOf(projectText, pProgram->identifier);
+			programLocations[programIdx] = pProgram->identifier.begin;
+		} else
+		{
+			auto reusedOffset = programIdx < parsedProgramsBegin ? 0 : reuse.suffixOffset;
+			project.programNames[programIdx] = rebaseRange(previous->programNames[reusedIdx], reusedOffset);
+		}
+		auto name = textRangeSlice(projectText, project.programNames[programIdx]);
+		auto nameId = internName(project.names, projectText, name);
+		project.programNameIds[programIdx] = nameId;
+
+		// Programs should have nowhere near 255 shaders attached
+		if (parsed && pProgram->attachedShaderCount > 255)
+		{
+			addError(
+				scratchMem,
+				parser,
+				pProgram->identifier.begin,
+				ProjectErrorType::ProgramExceedsAttachedShaderLimit);
+			project.programAttachments[programIdx] = attachmentsEnd;
+			project.programHashes[programIdx] = 0;
+			pProgram = pProgram->next;
+			continue;
+		}
+
+		// check the program name for uniqueness
+		if (programByName[nameId] != 0)
+		{
+			addError(scratchMem, parser, programLocations[programIdx], ProjectErrorType::DuplicateProgramName);
+		}
+		programByName[nameId] = programIdx + 1;
+
+		if (parsed)
+		{
+			auto shaderListLength = pProgram->attachedShaderCount;
+			attachmentsEnd -= shaderListLength;
+			project.programAttachments[programIdx] = attachmentsEnd;
+			auto attachedShaders = project.attachedShaders + attachmentsEnd;
+
+			// look up the indices of attached shaders
+			for (u32 i = 0; i < shaderListLength; ++i)
+			{
+				auto shader = pProgram->attachedShaders[i];
+				auto shaderNameId = findNameId(project.names, projectText, shader.identifier);
+				if (shaderNameId != invalidNameId && shaderByName[shaderNameId] != 0)
+				{
+					attachedShaders[i] = shaderByName[shaderNameId] - 1;
+				} else if (externalShaders)
+				{
+					attachedShaders[i] =
+						externalShaderFlag | internName(project.names, projectText, shader.identifier);
+				} else
+				{
+					attachedShaders[i] = unresolvedShader;
+					addError(
+						scratchMem,
+						parser,
+						shader.identifier.begin,
+						ProjectErrorType::ProgramUnresolvedShaderIdent);
+				}
+			}
+			pProgram = pProgram->next;
+		} else
+		{
+			// The attached shaders of reused programs are looked up again by name,
+			// because shaders may have been added, removed, or renamed.
+			auto previousBegin = previous->programAttachments[reusedIdx];
+			auto shaderListLength = previous->programAttachments[reusedIdx + 1] - previousBegin;
+			attachmentsEnd -= shaderListLength;
+			project.programAttachments[programIdx] = attachmentsEnd;
+			auto attachedShaders = project.attachedShaders + attachmentsEnd;
+			auto listCursor = projectText.begin + project.programNames[programIdx].end;
+			while (*listCursor != '{')
+			{
+				++listCursor;
+			}
+			++listCursor;
+			for (u32 i = 0; i < shaderListLength; ++i)
+			{
+				// Shaders that may be declared in another file are named by where the
+				// program attaches them, like for parsed programs. Otherwise the
+				// previous project has no errors, so its attached shaders resolved,
+				// unless they were declared in another file.
+				auto previousShader = previous->attachedShaders[previousBegin + i];
+				StringSlice name;
+				if (externalShaders)
+				{
+					name = readAttachedShaderIdentifier(listCursor);
+				} else if ((previousShader & externalShaderFlag) != 0)
+				{
+					name = textRangeSlice(previous->text, previous->names.names[previousShader & ~externalShaderFlag]);
+				} else
+				{
+					name = textRangeSlice(previous->text, previous->shaderNames[previousShader]);
+				}
+				auto shaderNameId = findNameId(project.names, projectText, name);
+				if (shaderNameId != invalidNameId && shaderByName[shaderNameId] != 0)
+				{
+					attachedShaders[i] = shaderByName[shaderNameId] - 1;
+				} else if (externalShaders)
+				{
+					attachedShaders[i] = externalShaderFlag | internName(project.names, projectText, name);
+				} else
+				{
+					attachedShaders[i] = unresolvedShader;
+					addError(
+						scratchMem,
+						parser,
+						programLocations[programIdx],
+						ProjectErrorType::ProgramUnresolvedShaderIdent);
+				}
+			}
+		}
+
+		project.programHashes[programIdx] = programHash(project, programIdx);
+		checkProgramStages(scratchMem, parser, project, programIdx, programLocations[programIdx]);
+	}
+	checkAttachedShaderVersions(scratchMem, parser, project);
+
+	// Shaders declared in other files are not in the shader array, so the index
+	// of a project with includes is built when it is linked
+	if (!externalShaders)
+	{
+		buildShaderProgramIndex(permMem, project);
+	}
+	return project;
+}
+
+/// Appends the results of a chunk that was parsed on its own to the main parser.
+/// The main parser's cursor must be at the beginning of the chunk.
+static void mergeChunk(ProjectParser& parser, ProjectParser& chunk, char *chunkBegin)
+{
+	assert(parser.cursor == chunkBegin);
+
+	if (chunk.shaders != nullptr)
+	{
+		auto pShader = chunk.shaders;
+		while (pShader->next != nullptr)
+		{
+			pShader = pShader->next;
+		}
+		pShader->next = parser.shaders;
+		parser.shaders = chunk.shaders;
+		parser.shaderCount += chunk.shaderCount;
+	}
+
+	if (chunk.programs != nullptr)
+	{
+		auto pProgram = chunk.programs;
+		while (pProgram->next != nullptr)
+		{
+			pProgram = pProgram->next;
+		}
+		pProgram->next = parser.programs;
+		parser.programs = chunk.programs;
+		parser.programCount += chunk.programCount;
+	}
+
+	if (chunk.declarations != nullptr)
+	{
+		auto pDeclaration = chunk.declarations;
+		while (pDeclaration->next != nullptr)
+		{
+			pDeclaration = pDeclaration->next;
+		}
+		pDeclaration->next = parser.declarations;
+		parser.declarations = chunk.declarations;
+		parser.declarationCount += chunk.declarationCount;
+	}
+
+	if (chunk.includes != nullptr)
+	{
+		auto pInclude = chunk.includes;
+		while (pInclude->next != nullptr)
+		{
+			pInclude = pInclude->next;
+		}
+		pInclude->next = parser.includes;
+		parser.includes = chunk.includes;
+		parser.includeCount += chunk.includeCount;
+	}
+
+	if (chunk.buffers != nullptr)
+	{
+		auto pBuffer = chunk.buffers;
+		while (pBuffer->next != nullptr)
+		{
+			pBuffer = pBuffer->next;
+		}
+		pBuffer->next = parser.buffers;
+		parser.buffers = chunk.buffers;
+		parser.bufferCount += chunk.bufferCount;
+	}
+
+	if (chunk.errors != nullptr)
+	{
+		auto pError = chunk.errors;
+		while (pError->next != nullptr)
+		{
+			pError = pError->next;
+		}
+		pError->next = parser.errors;
+		parser.errors = chunk.errors;
+		parser.errorCount += chunk.errorCount;
+	}
+
+	parser.cursor = chunk.cursor;
+}
+
+/// A worker stack that runs out of memory jumps out of the job that pushed to
+/// it. What the caller does when its own stacks run out cannot be done here,
+/// because it may jump to another thread's stack.
+static void failParseChunkJob(MemStack&, void *data)
+{
+	auto job = (ParseChunkJob*) data;
+	longjmp(job->outOfMemory, 1);
+}
+
+static void parseChunkJob(void *data)
+{
+	auto job = (ParseChunkJob*) data;
+	auto onFailure = job->mem->onFailure;
+	auto failureData = job->mem->failureData;
+	job->mem->onFailure = failParseChunkJob;
+	job->mem->failureData = job;
+	// Nothing parsing a chunk has a destructor to skip
+#ifdef _MSC_VER
+#pragma warning(suppress: 4611)
+#endif
+	if (setjmp(job->outOfMemory) == 0)
+	{
+		job->success = parseDeclarations(*job->mem, job->parser, job->end);
+	} else
+	{
+		job->ranOutOfMemory = true;
+	}
+	job->mem->onFailure = onFailure;
+	job->mem->failureData = failureData;
+}
+
+/// Splits the rest of the text into chunks that are parsed on separate threads.
+/// Each chunk's parse stops at the first declaration boundary at or past the end
+/// of the chunk. If that is not exactly where the next chunk begins, the next
+/// chunk began inside a declaration, and its speculative results are thrown away.
+/// Like parseDeclarations, this returns false if there were too many errors.
+/// The merged results point into the workers' stacks, which the caller pops to
+/// the jobs' markers once it is done with them.
+static bool parseDeclarationsParallel(
+	MemStack& scratchMem,
+	WorkerMemStacks const& workers,
+	ProjectParser& parser,
+	u32 chunkCount,
+	ParseChunkJob*& jobs,
+	u32& jobCount)
+{
+	jobs = memStackPushArray(scratchMem, ParseChunkJob, chunkCount);
+	jobCount = 0;
+	{
+		auto textBegin = parser.cursor;
+		auto textSize = (size_t) (parser.end - parser.cursor);
+		auto chunkBegin = parser.cursor;
+		for (u32 i = 1; i <= chunkCount; ++i)
+		{
+			auto chunkEnd = parser.end;
+			if (i < chunkCount)
+			{
+				auto splitTarget = textBegin + textSize / chunkCount * i;
+				if (splitTarget < chunkBegin)
+				{
+					splitTarget = chunkBegin;
+				}
+				chunkEnd = findDeclarationStart(splitTarget, parser.end);
+			}
+			if (chunkEnd == chunkBegin)
+			{
+				continue;
+			}
+
+			jobs[jobCount] = {};
+			jobs[jobCount].begin = chunkBegin;
+			jobs[jobCount].end = chunkEnd;
+			++jobCount;
+			chunkBegin = chunkEnd;
+		}
+	}
+
+	// Job i runs on thread i, and pushes to that thread's worker stack. A chunk
+	// can run on to the end of the text, so each stack needs room for the tokens
+	// of all the text from the beginning of its chunk, plus room for errors.
+	// Stacks with that much room only run out of memory when the text has
+	// errors, or the system has no memory left to commit.
+	for (u32 i = 0; i < jobCount; ++i)
+	{
+		auto& job = jobs[i];
+		job.mem = workers.stacks + i;
+		job.memMarker = memStackMark(*job.mem);
+		auto maxJobSize = maxParseBytesPerTextByte * (size_t) (parser.end - job.begin) + 64 * 1024;
+		if ((size_t) (job.mem->end - job.mem->top) < maxJobSize)
+		{
+			// Without the memory to run the jobs, the whole text is parsed here
+			jobCount = 0;
+			return parseDeclarations(scratchMem, parser, parser.end);
+		}
+		// offsets are from the beginning of the whole text, not of the chunk
+		job.parser.textBegin = parser.textBegin;
+		job.parser.cursor = job.begin;
+		job.parser.end = parser.end;
+	}
+
+	PLATFORM_runJobs(scratchMem, parseChunkJob, jobs, sizeof(ParseChunkJob), jobCount);
+
+	for (u32 i = 0; i < jobCount; ++i)
+	{
+		auto& job = jobs[i];
+		if (job.ranOutOfMemory)
+		{
+			// Parsed here, running out of memory is handled the way the caller
+			// handles it
+			if (parser.cursor < job.end && !parseDeclarations(scratchMem, parser, job.end))
+			{
+				return false;
+			}
+		} else if (parser.cursor == job.begin)
+		{
+			mergeChunk(parser, job.parser, job.begin);
+			if (!job.success)
+			{
+				return false;
+			}
+		} else if (parser.cursor < job.end)
+		{
+			// The previous chunk overran the start of this one, so parse the rest of
+			// this chunk again from where the previous one stopped
+			if (!parseDeclarations(scratchMem, parser, job.end))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/// Finds where each line of a text begins. A line break may be "\n", "\r",
+/// "\r\n", or "\n\r", and runs of newline characters pair up from the left.
+/// The text is scanned 16 bytes at a time, and only the newline characters
+/// that are found are looked at one at a time.
+LineIndex buildLineIndex(MemStack& mem, StringSlice text)
+{
+	LineIndex result = {};
+	result.lineBegins = memStackPushType(mem, u32);
+	result.lineBegins[0] = 0;
+	result.lineCount = 1;
+
+	// The character that would complete a two character line break started by
+	// the last newline character, or zero if it did not start a line break
+	char pairChar = 0;
+	auto lastNewline = text.begin;
+	auto p = text.begin;
+	while (p != text.end)
+	{
+		u32 newlines = 0;
+		u32 length = 16;
+		if (text.end - p >= 16)
+		{
+			auto chars = _mm_loadu_si128((__m128i*) p);
+			newlines = byteMask(chars, '\n') | byteMask(chars, '\r');
+		} else
+		{
+			length = (u32) (text.end - p);
+			for (u32 i = 0; i < length; ++i)
+			{
+				if (p[i] == '\n' || p[i] == '\r')
+				{
+					newlines |= 1u << i;
+				}
+			}
+		}
+
+		while (newlines != 0)
+		{
+			auto newline = p + countTrailingZeros(newlines);
+			auto lineBegin = (u32) (newline + 1 - text.begin);
+			if (pairChar != 0 && *newline == pairChar && newline == lastNewline + 1)
+			{
+				result.lineBegins[result.lineCount - 1] = lineBegin;
+				pairChar = 0;
+			} else
+			{
+				*memStackPushType(mem, u32) = lineBegin;
+				++result.lineCount;
+				pairChar = *newline == '\n' ? '\r' : '\n';
+			}
+			lastNewline = newline;
+			newlines &= newlines - 1;
+		}
+		p += length;
+	}
+	return result;
+}
+
+/// Finds the line and character numbers of an offset in a text, with a binary
+/// search of the text's line index
+TextLocation findTextLocation(LineIndex const& lineIndex, StringSlice text, u32 offset)
+{
+	// the first line begins at zero, so the offset is always past some line's beginning
+	u32 low = 0;
+	u32 high = lineIndex.lineCount;
+	while (high - low > 1)
+	{
+		auto middle = low + (high - low) / 2;
+		if (lineIndex.lineBegins[middle] <= offset)
+		{
+			low = middle;
+		} else
+		{
+			high = middle;
+		}
+	}
+	return TextLocation{text.begin + offset, low + 1, offset - lineIndex.lineBegins[low] + 1};
+}
+
+/// Finds the bounds of a line, not including the line break that ends it
+StringSlice findLine(LineIndex const& lineIndex, StringSlice text, u32 lineIdx)
+{
+	assert(lineIdx < lineIndex.lineCount);
+	auto begin = text.begin + lineIndex.lineBegins[lineIdx];
+	if (lineIdx + 1 == lineIndex.lineCount)
+	{
+		return StringSlice{begin, text.end};
+	}
+
+	// lines do not contain newline characters, so any at the end are the line break
+	auto end = text.begin + lineIndex.lineBegins[lineIdx + 1];
+	while (end != begin && (end[-1] == '\n' || end[-1] == '\r'))
+	{
+		--end;
+	}
+	return StringSlice{begin, end};
+}
+
+/// Finds the line and character numbers of errors, which must all be in the text
+static void locateErrors(LineIndex const& lineIndex, StringSlice text, ProjectError *errors, u32 errorCount)
+{
+	for (u32 i = 0; i < errorCount; ++i)
+	{
+		auto offset = (u32) (errors[i].location.srcPtr - text.begin);
+		errors[i].location = findTextLocation(lineIndex, text, offset);
+	}
+}
+
+/// Copies the errors to an array, sorted by where they are in the text. Errors
+/// at the same place stay in the order they were found. Only the pointers of
+/// their locations are set, and the line and character numbers are found after.
+static void collectErrors(MemStack& permMem, ProjectParser& parser, ProjectErrors& errors)
+{
+	errors = {};
+	errors.count = parser.errorCount;
+	errors.ptr = memStackPushArray(permMem, ProjectError, parser.errorCount);
+
+	// The list is in reverse order of when errors were found, which is nearly
+	// sorted already, so an insertion sort does little work
+	auto pError = parser.errors;
+	u32 i = parser.errorCount;
+	while (pError != nullptr)
+	{
+		--i;
+		errors.ptr[i].type = pError->type;
+		errors.ptr[i].location = TextLocation{parser.textBegin + pError->offset, 0, 0};
+		pError = pError->next;
+	}
+	for (i = 1; i < errors.count; ++i)
+	{
+		auto error = errors.ptr[i];
+		auto j = i;
+		while (j > 0 && errors.ptr[j - 1].location.srcPtr > error.location.srcPtr)
+		{
+			errors.ptr[j] = errors.ptr[j - 1];
+			--j;
+		}
+		errors.ptr[j] = error;
+	}
+
+	// Chunks parsed in parallel each stop at the maximum on their own
+	if (errors.count > maxProjectErrors)
+	{
+		errors.count = maxProjectErrors;
+	}
+}
+
+/// Builds a project from a parser that has parsed all of the text. Any errors
+/// are collected instead.
+static Project buildParsedProject(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	ProjectParser& parser,
+	StringSlice projectText,
+	Version version,
+	u32 versionEnd,
+	bool includedFile,
+	ProjectErrors& errors)
+{
+	auto projectMemMarker = memStackMark(permMem);
+
+	ReusedDeclarations reuse = {};
+	auto externalShaders = includedFile || parser.includeCount != 0;
+	auto project = buildProject(permMem, scratchMem, parser, projectText, reuse, externalShaders);
+	if (parser.errorCount == 0)
+	{
+		project.version = version;
+		project.versionEnd = versionEnd;
+		errors = {};
+		return project;
+	}
+
+	memStackPop(permMem, projectMemMarker);
+	collectErrors(permMem, parser, errors);
+	errors.lines = buildLineIndex(permMem, projectText);
+	locateErrors(errors.lines, projectText, errors.ptr, errors.count);
+	return Project{};
+}
+
+/// Included files do not begin with a version statement, because they are
+/// always part of a project that has one.
+static Project parseProjectWithThreads(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	WorkerMemStacks const& workers,
+	StringSlice projectText,
+	bool includedFile,
+	ProjectErrors& errors)
+{
+	ProjectParser parser = {};
+	parser.textBegin = projectText.begin;
+	parser.cursor = projectText.begin;
+	parser.end = projectText.end;
+
+	Version version = {};
+	if (!includedFile)
+	{
+		auto versionStart = parser;
+		if (!parseVersion(scratchMem, parser, version))
+		{
+			skipFailedDeclaration(parser, versionStart);
+		}
+	}
+
+	auto versionEnd = (u32) (parser.cursor - projectText.begin);
+
+	auto chunkCount = workers.count;
+	auto maxChunkCount = (size_t) (parser.end - parser.cursor) / minParallelChunkSize;
+	if (maxChunkCount < chunkCount)
+	{
+		chunkCount = (u32) maxChunkCount;
+	}
+
+	// Names are resolved even when some declarations failed to parse, so that
+	// errors in the ones that did parse are reported too
+	ParseChunkJob *jobs = nullptr;
+	u32 jobCount = 0;
+	if (chunkCount > 1)
+	{
+		parseDeclarationsParallel(scratchMem, workers, parser, chunkCount, jobs, jobCount);
+	} else
+	{
+		parseDeclarations(scratchMem, parser, parser.end);
+	}
+
+	auto project = buildParsedProject(
+		permMem, scratchMem, parser, projectText, version, versionEnd, includedFile, errors);
+	// The project has its own copy of everything it needs from the chunks
+	for (u32 i = 0; i < jobCount; ++i)
+	{
+		memStackPop(*jobs[i].mem, jobs[i].memMarker);
+	}
+	return project;
+}
+
+Project parseProject(MemStack& permMem, MemStack& scratchMem, StringSlice projectText, ProjectErrors& errors)
+{
+	WorkerMemStacks noWorkers = {};
+	return parseProjectWithThreads(permMem, scratchMem, noWorkers, projectText, false, errors);
+}
+
+/// Parses a project on up to one thread per worker stack. The result is the
+/// same as from parseProject.
+Project parseProjectParallel(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	WorkerMemStacks const& workers,
+	StringSlice projectText,
+	ProjectErrors& errors)
+{
+	return parseProjectWithThreads(permMem, scratchMem, workers, projectText, false, errors);
+}
+
+/// Parses a file included by a project. The result is not a complete project
+/// until it is linked with the rest of the project's files.
+Project parseIncludedProjectFile(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	WorkerMemStacks const& workers,
+	StringSlice fileText,
+	ProjectErrors& errors)
+{
+	return parseProjectWithThreads(permMem, scratchMem, workers, fileText, true, errors);
+}
+
+void beginProjectStream(ProjectStreamParser& stream, char *textBegin)
+{
+	stream = {};
+	stream.textBegin = textBegin;
+	stream.parser.textBegin = textBegin;
+	stream.parser.cursor = textBegin;
+	stream.parser.end = textBegin;
+	stream.retryEnd = textBegin;
+}
+
+/// Parses the declarations that are known to be complete in the text read so
+/// far. A declaration that reaches the end of that text, whether it parsed or
+/// not, might have parsed differently with more text, so it is thrown away and
+/// tried again once more text has been read. The text read so far must grow by
+/// the length of the retried declaration before it is tried again, so that a
+/// declaration that spans many reads is not parsed a number of times that grows
+/// with its length.
+void continueProjectStream(MemStack& scratchMem, ProjectStreamParser& stream, char *textEnd)
+{
+	if (stream.stopped || textEnd < stream.retryEnd)
+	{
+		return;
+	}
+
+	auto& parser = stream.parser;
+	parser.end = textEnd;
+	for (;;)
+	{
+		auto memMarker = memStackMark(scratchMem);
+		auto retryState = parser;
+
+		bool parsed;
+		if (stream.versionParsed)
+		{
+			skipWhitespace(parser);
+			if (parser.cursor == parser.end)
+			{
+				parser = retryState;
+				return;
+			}
+		}
+		auto declarationStart = parser;
+		if (stream.versionParsed)
+		{
+			parsed = parseDeclaration(scratchMem, parser);
+		} else
+		{
+			parsed = parseVersion(scratchMem, parser, stream.version);
+		}
+
+		auto stop = !parsed && stream.versionParsed && parser.errorCount >= maxProjectErrors;
+		auto reachedEnd = parser.cursor == parser.end;
+		if (!parsed && !stop && !reachedEnd)
+		{
+			skipFailedDeclaration(parser, declarationStart);
+			reachedEnd = parser.cursor == parser.end;
+		}
+
+		if (reachedEnd)
+		{
+			parser = retryState;
+			memStackPop(scratchMem, memMarker);
+			stream.retryEnd = textEnd + (textEnd - declarationStart.cursor);
+			return;
+		}
+
+		if (stop)
+		{
+			stream.stopped = true;
+			return;
+		}
+
+		if (!stream.versionParsed)
+		{
+			stream.versionParsed = true;
+			stream.versionEnd = (u32) (parser.cursor - stream.textBegin);
+		}
+	}
+}
+
+/// Parses the rest of a stream once all of its text has been read. The result
+/// is the same as from parseProject on the whole text.
+Project finishProjectStream(
+	MemStack& permMem, MemStack& scratchMem, ProjectStreamParser& stream, char *textEnd, ProjectErrors& errors)
+{
+	auto& parser = stream.parser;
+	parser.end = textEnd;
+	if (!stream.versionParsed)
+	{
+		auto versionStart = parser;
+		if (!parseVersion(scratchMem, parser, stream.version))
+		{
+			skipFailedDeclaration(parser, versionStart);
+		}
+		stream.versionEnd = (u32) (parser.cursor - stream.textBegin);
+	}
+	if (!stream.stopped)
+	{
+		parseDeclarations(scratchMem, parser, parser.end);
+	}
+
+	auto projectText = StringSlice{stream.textBegin, textEnd};
+	return buildParsedProject(
+		permMem, scratchMem, parser, projectText, stream.version, stream.versionEnd, false, errors);
+}
+
+/// Combines the files of a project into one project, and resolves the names of
+/// attached shaders across all of them. The first file is the project file, and
+/// the rest are the files it includes. None of the files may have errors. The
+/// text of the files is copied into the result, one file after another, so the
+/// result does not depend on the files once it is linked.
+Project linkProject(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	Project const *const *files,
+	u32 fileCount,
+	ProjectErrors& errors)
+{
+	assert(fileCount != 0);
+	auto scratchMemMarker = memStackMark(scratchMem);
+	auto projectMemMarker = memStackMark(permMem);
+
+	// Only used to collect errors, with locations in the project text
+	ProjectParser parser = {};
+
+	auto const& root = *files[0];
+	Project project = {};
+	project.version = root.version;
+	project.versionEnd = root.versionEnd;
+	project.declarationCount = root.declarationCount;
+	project.declarations = memStackPushArray(permMem, Declaration, project.declarationCount);
+	memcpy(project.declarations, root.declarations, project.declarationCount * sizeof(Declaration));
+	project.includeCount = root.includeCount;
+	project.includes = memStackPushArray(permMem, Include, project.includeCount);
+
+	// The offset of each file's text in the project text. The project file comes
+	// first, so the offsets of its declarations stay the same.
+	auto textOffsets = memStackPushArray(scratchMem, u32, fileCount);
+	u32 maxNameCount = 0;
+	{
+		size_t textLength = 0;
+		for (u32 fileIdx = 0; fileIdx < fileCount; ++fileIdx)
+		{
+			auto const& file = *files[fileIdx];
+			textOffsets[fileIdx] = (u32) textLength;
+			textLength += stringSliceLength(file.text);
+			project.shaderCount += file.shaderCount;
+			project.programCount += file.programCount;
+			project.attachedShaderCount += file.attachedShaderCount;
+			project.bufferCount += file.bufferCount;
+			project.bufferValueCount += file.bufferValueCount;
+			// every name in the files is a name of the project
+			maxNameCount += file.names.nameCount;
+		}
+
+		auto text = memStackPushArrayAligned(permMem, char, textLength, cacheLineSize);
+		for (u32 fileIdx = 0; fileIdx < fileCount; ++fileIdx)
+		{
+			auto const& file = *files[fileIdx];
+			memcpy(text + textOffsets[fileIdx], file.text.begin, stringSliceLength(file.text));
+		}
+		project.text = StringSlice{text, text + textLength};
+		parser.textBegin = text;
+	}
+
+	// Include paths point into the text of the project file, which is at the
+	// beginning of the project text
+	for (u32 i = 0; i < project.includeCount; ++i)
+	{
+		auto path = root.includes[i].path;
+		auto pathBegin = project.text.begin + (path.begin - root.text.begin);
+		project.includes[i].path = StringSlice{pathBegin, pathBegin + stringSliceLength(path)};
+		project.includes[i].offset = root.includes[i].offset;
+	}
+
+	project.shaderTypes = memStackPushArray(permMem, ShaderType, project.shaderCount);
+	project.shaderNames = memStackPushArray(permMem, TextRange, project.shaderCount);
+	project.shaderNameIds = memStackPushArray(permMem, u32, project.shaderCount);
+	project.shaderSources = memStackPushArray(permMem, TextRange, project.shaderCount);
+	project.shaderHashes = memStackPushArray(permMem, u64, project.shaderCount);
+	project.programNames = memStackPushArray(permMem, TextRange, project.programCount);
+	project.programNameIds = memStackPushArray(permMem, u32, project.programCount);
+	project.programAttachments = memStackPushArray(permMem, u32, project.programCount + 1);
+	project.attachedShaders = memStackPushArray(permMem, u32, project.attachedShaderCount);
+	project.programHashes = memStackPushArray(permMem, u64, project.programCount);
+	project.bufferElementTypes = memStackPushArray(permMem, BufferElementType, project.bufferCount);
+	project.bufferNames = memStackPushArray(permMem, TextRange, project.bufferCount);
+	project.bufferNameIds = memStackPushArray(permMem, u32, project.bufferCount);
+	project.bufferValueOffsets = memStackPushArray(permMem, u32, project.bufferCount + 1);
+	project.bufferValues = memStackPushArray(permMem, u32, project.bufferValueCount);
+	project.bufferHashes = memStackPushArray(permMem, u64, project.bufferCount);
+	project.names = initNameTable(permMem, maxNameCount);
+
+	// The index of the shader, program, and buffer with each name, plus one, or
+	// zero if there is none
+	auto shaderByName = memStackPushArray(scratchMem, u32, maxNameCount);
+	memset(shaderByName, 0, maxNameCount * sizeof(u32));
+	auto programByName = memStackPushArray(scratchMem, u32, maxNameCount);
+	memset(programByName, 0, maxNameCount * sizeof(u32));
+	auto bufferByName = memStackPushArray(scratchMem, u32, maxNameCount);
+	memset(bufferByName, 0, maxNameCount * sizeof(u32));
+
+	{
+		u32 bufferIdx = 0;
+		u32 valuesBegin = 0;
+		for (u32 fileIdx = 0; fileIdx < fileCount; ++fileIdx)
+		{
+			auto const& file = *files[fileIdx];
+			for (u32 i = 0; i < file.bufferCount; ++i)
+			{
+				valuesBegin += rebaseBuffer(project, bufferIdx, valuesBegin, file, i, textOffsets[fileIdx]);
+				auto name = textRangeSlice(project.text, project.bufferNames[bufferIdx]);
+				project.bufferNameIds[bufferIdx] = internName(project.names, project.text, name);
+				++bufferIdx;
+			}
+		}
+		project.bufferValueOffsets[project.bufferCount] = project.bufferValueCount;
+	}
+	for (u32 bufferIdx = project.bufferCount; bufferIdx-- > 0; )
+	{
+		auto nameId = project.bufferNameIds[bufferIdx];
+		if (bufferByName[nameId] != 0)
+		{
+			auto location = project.text.begin + project.bufferNames[bufferIdx].begin;
+			addError(scratchMem, parser, location, ProjectErrorType::DuplicateBufferName);
+		}
+		bufferByName[nameId] = bufferIdx + 1;
+	}
+
+	{
+		u32 shaderIdx = 0;
+		for (u32 fileIdx = 0; fileIdx < fileCount; ++fileIdx)
+		{
+			auto const& file = *files[fileIdx];
+			auto offset = textOffsets[fileIdx];
+			for (u32 i = 0; i < file.shaderCount; ++i)
+			{
+				rebaseShader(project, shaderIdx, file, i, offset);
+				auto name = textRangeSlice(project.text, project.shaderNames[shaderIdx]);
+				project.shaderNameIds[shaderIdx] = internName(project.names, project.text, name);
+				++shaderIdx;
+			}
+		}
+	}
+
+	// Like in a single file, shaders are seen last to first, so that names
+	// resolve to the first shader with that name
+	for (u32 fileIdx = fileCount, shaderIdx = project.shaderCount; fileIdx-- > 0; )
+	{
+		auto const& file = *files[fileIdx];
+		for (u32 i = file.shaderCount; i-- > 0; )
+		{
+			--shaderIdx;
+			auto nameId = project.shaderNameIds[shaderIdx];
+			if (shaderByName[nameId] != 0)
+			{
+				auto location = project.text.begin + project.shaderNames[shaderIdx].begin;
+				addError(scratchMem, parser, location, ProjectErrorType::DuplicateShaderName);
+			}
+			shaderByName[nameId] = shaderIdx + 1;
+		}
+	}
+
+	// Programs are walked last to first, so the attached shader array is filled
+	// from its end
+	project.programAttachments[project.programCount] = project.attachedShaderCount;
+	auto attachmentsEnd = project.attachedShaderCount;
+	for (u32 fileIdx = fileCount, programIdx = project.programCount; fileIdx-- > 0; )
+	{
+		auto const& file = *files[fileIdx];
+		auto offset = textOffsets[fileIdx];
+		for (u32 i = file.programCount; i-- > 0; )
+		{
+			--programIdx;
+			project.programNames[programIdx] = rebaseRange(file.programNames[i], offset);
+			auto name = textRangeSlice(project.text, project.programNames[programIdx]);
+			auto nameId = internName(project.names, project.text, name);
+			project.programNameIds[programIdx] = nameId;
+			if (programByName[nameId] != 0)
+			{
+				addError(scratchMem, parser, name.begin, ProjectErrorType::DuplicateProgramName);
+			}
+			programByName[nameId] = programIdx + 1;
+
+			// Attached shaders are looked up again by name, whether the file
+			// resolved them itself or left them to be found in another file
+			auto fileBegin = file.programAttachments[i];
+			auto shaderListLength = file.programAttachments[i + 1] - fileBegin;
+			attachmentsEnd -= shaderListLength;
+			project.programAttachments[programIdx] = attachmentsEnd;
+			for (u32 j = 0; j < shaderListLength; ++j)
+			{
+				auto fileShader = file.attachedShaders[fileBegin + j];
+				auto shaderName = (fileShader & externalShaderFlag) != 0
+					? textRangeSlice(file.text, file.names.names[fileShader & ~externalShaderFlag])
+					: textRangeSlice(file.text, file.shaderNames[fileShader]);
+				auto shaderNameId = findNameId(project.names, project.text, shaderName);
+				auto& attachedShader = project.attachedShaders[attachmentsEnd + j];
+				if (shaderNameId != invalidNameId && shaderByName[shaderNameId] != 0)
+				{
+					attachedShader = shaderByName[shaderNameId] - 1;
+				} else
+				{
+					attachedShader = unresolvedShader;
+					auto location = project.text.begin + offset + (shaderName.begin - file.text.begin);
+					addError(scratchMem, parser, location, ProjectErrorType::ProgramUnresolvedShaderIdent);
+				}
+			}
+			project.programHashes[programIdx] = programHash(project, programIdx);
+			checkProgramStages(scratchMem, parser, project, programIdx, name.begin);
+		}
+	}
+	checkAttachedShaderVersions(scratchMem, parser, project);
+
+	if (parser.errorCount != 0)
+	{
+		memStackPop(permMem, projectMemMarker);
+		collectErrors(permMem, parser, errors);
+
+		// Errors are sorted by their offset in the project text, so the errors in
+		// each file are next to each other. Their locations are moved from the
+		// project text, which was just popped, to the text of the file.
+		u32 errorIdx = 0;
+		for (u32 fileIdx = 0; fileIdx < fileCount; ++fileIdx)
+		{
+			auto const& file = *files[fileIdx];
+			auto fileEnd = textOffsets[fileIdx] + stringSliceLength(file.text);
+			auto fileErrorsBegin = errorIdx;
+			while (errorIdx < errors.count
+				&& (size_t) (errors.ptr[errorIdx].location.srcPtr - project.text.begin) < fileEnd)
+			{
+				auto& location = errors.ptr[errorIdx].location;
+				location.srcPtr = file.text.begin + (location.srcPtr - project.text.begin - textOffsets[fileIdx]);
+				++errorIdx;
+			}
+			if (errorIdx != fileErrorsBegin)
+			{
+				auto lineIndex = buildLineIndex(scratchMem, file.text);
+				locateErrors(lineIndex, file.text, errors.ptr + fileErrorsBegin, errorIdx - fileErrorsBegin);
+			}
+		}
+		memStackPop(scratchMem, scratchMemMarker);
+		return Project{};
+	}
+
+	buildShaderProgramIndex(permMem, project);
+	memStackPop(scratchMem, scratchMemMarker);
+	errors = {};
+	return project;
+}
+
+/// Returns the number of leading bytes that are equal in two blocks of memory
+static size_t commonPrefixLength(char *lhs, char *rhs, size_t length)
+{
+	size_t result = 0;
+	while (length - result >= 16)
+	{
+		auto lhsChars = _mm_loadu_si128((__m128i*) (lhs + result));
+		auto rhsChars = _mm_loadu_si128((__m128i*) (rhs + result));
+		auto differences = ~((u32) _mm_movemask_epi8(_mm_cmpeq_epi8(lhsChars, rhsChars))) & 0xFFFF;
+		if (differences != 0)
+		{
+			return result + countTrailingZeros(differences);
+		}
+		result += 16;
+	}
+	while (result != length && lhs[result] == rhs[result])
+	{
+		++result;
+	}
+	return result;
+}
+
+/// Returns the number of trailing bytes that are equal in two blocks of memory,
+/// given pointers to the ends of the blocks
+static size_t commonSuffixLength(char *lhsEnd, char *rhsEnd, size_t length)
+{
+	size_t result = 0;
+	while (length - result >= 16)
+	{
+		auto lhsChars = _mm_loadu_si128((__m128i*) (lhsEnd - result - 16));
+		auto rhsChars = _mm_loadu_si128((__m128i*) (rhsEnd - result - 16));
+		auto differences = ~((u32) _mm_movemask_epi8(_mm_cmpeq_epi8(lhsChars, rhsChars))) & 0xFFFF;
+		if (differences != 0)
+		{
+			return result + 15 - highestSetBit(differences);
+		}
+		result += 16;
+	}
+	while (result != length && lhsEnd[-(i64) result - 1] == rhsEnd[-(i64) result - 1])
+	{
+		++result;
+	}
+	return result;
+}
+
+inline static void advanceDeclarationCursor(Project const& project, DeclarationCursor& cursor)
+{
+	switch (project.declarations[cursor.declarationIdx].type)
+	{
+	case DeclarationType::Shader:
+		++cursor.shaderIdx;
+		break;
+	case DeclarationType::Program:
+		++cursor.programIdx;
+		break;
+	case DeclarationType::Include:
+		++cursor.includeIdx;
+		break;
+	case DeclarationType::Buffer:
+		++cursor.bufferIdx;
+		break;
+	}
+	++cursor.declarationIdx;
+}
+
+/// Copies the previous project, with the declarations parsed from the changed
+/// text in place of the ones they replace. This is only done when the parsed
+/// declarations have the same shaders, programs, and buffers as the ones they
+/// replace, with the same names and in the same order, and their programs
+/// attach the same shaders. Then the names, the attached shaders, and the
+/// reverse index of the previous project are all still right. Nothing is
+/// interned or resolved again, and only the programs that attach changed
+/// shaders are hashed and checked again. The arrays are still copied, because
+/// the new project is kept in other memory than the previous one, but that is a
+/// straight copy, apart from moving the text ranges after the change. Returns
+/// false, without pushing anything, if the parsed declarations do not match.
+static bool spliceProject(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	ProjectParser& parser,
+	StringSlice projectText,
+	ReusedDeclarations const& reuse,
+	Project& result)
+{
+	auto const& previous = *reuse.previous;
+	auto windowShaderCount = reuse.suffixShaderIdx - reuse.prefixShaderCount;
+	auto windowProgramCount = reuse.suffixProgramIdx - reuse.prefixProgramCount;
+	auto windowBufferCount = reuse.suffixBufferIdx - reuse.prefixBufferCount;
+	if (parser.shaderCount != windowShaderCount
+		|| parser.programCount != windowProgramCount
+		|| parser.bufferCount != windowBufferCount
+		|| parser.includeCount != 0
+		|| previous.includeCount != 0)
+	{
+		return false;
+	}
+
+	auto scratchMemMarker = memStackMark(scratchMem);
+
+	// The parsed lists are in reverse order
+	auto shaders = memStackPushArray(scratchMem, ShaderToken*, windowShaderCount);
+	auto shaderIdx = windowShaderCount;
+	for (auto pShader = parser.shaders; pShader != nullptr; pShader = pShader->next)
+	{
+		--shaderIdx;
+		shaders[shaderIdx] = pShader;
+	}
+	auto programs = memStackPushArray(scratchMem, ProgramToken*, windowProgramCount);
+	auto programIdx = windowProgramCount;
+	for (auto pProgram = parser.programs; pProgram != nullptr; pProgram = pProgram->next)
+	{
+		--programIdx;
+		programs[programIdx] = pProgram;
+	}
+	auto buffers = memStackPushArray(scratchMem, BufferToken*, windowBufferCount);
+	auto bufferIdx = windowBufferCount;
+	for (auto pBuffer = parser.buffers; pBuffer != nullptr; pBuffer = pBuffer->next)
+	{
+		--bufferIdx;
+		buffers[bufferIdx] = pBuffer;
+	}
+
+	for (u32 i = 0; i < windowShaderCount; ++i)
+	{
+		auto previousName = textRangeSlice(previous.text, previous.shaderNames[reuse.prefixShaderCount + i]);
+		if (shaders[i]->identifier != previousName)
+		{
+			memStackPop(scratchMem, scratchMemMarker);
+			return false;
+		}
+	}
+	for (u32 i = 0; i < windowProgramCount; ++i)
+	{
+		auto previousIdx = reuse.prefixProgramCount + i;
+		auto previousName = textRangeSlice(previous.text, previous.programNames[previousIdx]);
+		auto previousBegin = previous.programAttachments[previousIdx];
+		auto previousEnd = previous.programAttachments[previousIdx + 1];
+		if (programs[i]->identifier != previousName || programs[i]->attachedShaderCount != previousEnd - previousBegin)
+		{
+			memStackPop(scratchMem, scratchMemMarker);
+			return false;
+		}
+		// the previous project has no errors, so its attached shaders resolved,
+		// and the same names resolve to the same shaders, because they are unchanged
+		for (auto j = previousBegin; j < previousEnd; ++j)
+		{
+			auto shaderName = textRangeSlice(previous.text, previous.shaderNames[previous.attachedShaders[j]]);
+			if (programs[i]->attachedShaders[j - previousBegin].identifier != shaderName)
+			{
+				memStackPop(scratchMem, scratchMemMarker);
+				return false;
+			}
+		}
+	}
+	for (u32 i = 0; i < windowBufferCount; ++i)
+	{
+		auto previousName = textRangeSlice(previous.text, previous.bufferNames[reuse.prefixBufferCount + i]);
+		if (buffers[i]->identifier != previousName)
+		{
+			memStackPop(scratchMem, scratchMemMarker);
+			return false;
+		}
+	}
+
+	// The text that was parsed again, in the previous text. Ranges before it are
+	// unchanged, and ranges after it move by the suffix offset.
+	auto windowBegin = reuse.prefixDeclarationCount == 0
+		? 0
+		: previous.declarations[reuse.prefixDeclarationCount - 1].end;
+	auto windowEnd = reuse.suffixDeclarationIdx == previous.declarationCount
+		? (u32) stringSliceLength(previous.text)
+		: previous.declarations[reuse.suffixDeclarationIdx].begin;
+
+	Project project = {};
+	project.text = projectText;
+	project.version = previous.version;
+	project.versionEnd = previous.versionEnd;
+
+	project.declarationCount = previous.declarationCount;
+	project.declarations = memStackPushArray(permMem, Declaration, project.declarationCount);
+	memcpy(project.declarations, previous.declarations, reuse.prefixDeclarationCount * sizeof(Declaration));
+	{
+		auto declarationIdx = reuse.suffixDeclarationIdx;
+		for (auto pDeclaration = parser.declarations; pDeclaration != nullptr; pDeclaration = pDeclaration->next)
+		{
+			--declarationIdx;
+			project.declarations[declarationIdx].type = pDeclaration->type;
+			project.declarations[declarationIdx].begin = (u32) (pDeclaration->text.begin - projectText.begin);
+			project.declarations[declarationIdx].end = (u32) (pDeclaration->text.end - projectText.begin);
+		}
+	}
+	for (auto i = reuse.suffixDeclarationIdx; i < project.declarationCount; ++i)
+	{
+		auto declaration = previous.declarations[i];
+		declaration.begin = (u32) (declaration.begin + reuse.suffixOffset);
+		declaration.end = (u32) (declaration.end + reuse.suffixOffset);
+		project.declarations[i] = declaration;
+	}
+
+	// Shaders before the change are copied as they are. Shaders that were parsed
+	// again have the same names, so their name IDs are copied with the rest.
+	project.shaderCount = previous.shaderCount;
+	project.shaderTypes = memStackPushArray(permMem, ShaderType, project.shaderCount);
+	project.shaderNames = memStackPushArray(permMem, TextRange, project.shaderCount);
+	project.shaderNameIds = memStackPushArray(permMem, u32, project.shaderCount);
+	project.shaderSources = memStackPushArray(permMem, TextRange, project.shaderCount);
+	project.shaderHashes = memStackPushArray(permMem, u64, project.shaderCount);
+	memcpy(project.shaderTypes, previous.shaderTypes, reuse.prefixShaderCount * sizeof(ShaderType));
+	memcpy(project.shaderNames, previous.shaderNames, reuse.prefixShaderCount * sizeof(TextRange));
+	memcpy(project.shaderNameIds, previous.shaderNameIds, project.shaderCount * sizeof(u32));
+	memcpy(project.shaderSources, previous.shaderSources, reuse.prefixShaderCount * sizeof(TextRange));
+	memcpy(project.shaderHashes, previous.shaderHashes, reuse.prefixShaderCount * sizeof(u64));
+	auto changedShaders = memStackPushArray(scratchMem, u32, windowShaderCount);
+	u32 changedShaderCount = 0;
+	for (u32 i = 0; i < windowShaderCount; ++i)
+	{
+		auto idx = reuse.prefixShaderCount + i;
+		project.shaderTypes[idx] = shaders[i]->type;
+		project.shaderNames[idx] = textRangeOf(projectText, shaders[i]->identifier);
+		project.shaderSources[idx] = textRangeOf(projectText, shaders[i]->source);
+		project.shaderHashes[idx] = shaders[i]->hash;
+		// The hash covers the type, so a shader whose type changed is found too
+		if (shaders[i]->hash != previous.shaderHashes[idx])
+		{
+			changedShaders[changedShaderCount] = idx;
+			++changedShaderCount;
+		}
+	}
+	for (auto i = reuse.suffixShaderIdx; i < project.shaderCount; ++i)
+	{
+		rebaseShader(project, i, previous, i, reuse.suffixOffset);
+	}
+
+	project.programCount = previous.programCount;
+	project.programNames = memStackPushArray(permMem, TextRange, project.programCount);
+	project.programNameIds = memStackPushArray(permMem, u32, project.programCount);
+	project.programAttachments = memStackPushArray(permMem, u32, project.programCount + 1);
+	project.programHashes = memStackPushArray(permMem, u64, project.programCount);
+	project.attachedShaderCount = previous.attachedShaderCount;
+	project.attachedShaders = memStackPushArray(permMem, u32, project.attachedShaderCount);
+	memcpy(project.programNames, previous.programNames, reuse.prefixProgramCount * sizeof(TextRange));
+	memcpy(project.programNameIds, previous.programNameIds, project.programCount * sizeof(u32));
+	memcpy(project.programAttachments, previous.programAttachments, (project.programCount + 1) * sizeof(u32));
+	memcpy(project.programHashes, previous.programHashes, project.programCount * sizeof(u64));
+	memcpy(project.attachedShaders, previous.attachedShaders, project.attachedShaderCount * sizeof(u32));
+	for (u32 i = 0; i < windowProgramCount; ++i)
+	{
+		project.programNames[reuse.prefixProgramCount + i] = textRangeOf(projectText, programs[i]->identifier);
+	}
+	for (auto i = reuse.suffixProgramIdx; i < project.programCount; ++i)
+	{
+		project.programNames[i] = rebaseRange(previous.programNames[i], reuse.suffixOffset);
+	}
+
+	// The values of buffers that were parsed again may have changed in number,
+	// so the offsets of the values after them move by the difference
+	project.bufferCount = previous.bufferCount;
+	project.bufferElementTypes = memStackPushArray(permMem, BufferElementType, project.bufferCount);
+	project.bufferNames = memStackPushArray(permMem, TextRange, project.bufferCount);
+	project.bufferNameIds = memStackPushArray(permMem, u32, project.bufferCount);
+	project.bufferValueOffsets = memStackPushArray(permMem, u32, project.bufferCount + 1);
+	project.bufferHashes = memStackPushArray(permMem, u64, project.bufferCount);
+	memcpy(
+		project.bufferElementTypes, previous.bufferElementTypes, reuse.prefixBufferCount * sizeof(BufferElementType));
+	memcpy(project.bufferNames, previous.bufferNames, reuse.prefixBufferCount * sizeof(TextRange));
+	memcpy(project.bufferNameIds, previous.bufferNameIds, project.bufferCount * sizeof(u32));
+	memcpy(project.bufferValueOffsets, previous.bufferValueOffsets, (reuse.prefixBufferCount + 1) * sizeof(u32));
+	memcpy(project.bufferHashes, previous.bufferHashes, reuse.prefixBufferCount * sizeof(u64));
+	{
+		auto prefixValueCount = previous.bufferValueOffsets[reuse.prefixBufferCount];
+		auto suffixValuesBegin = previous.bufferValueOffsets[reuse.suffixBufferIdx];
+		auto suffixValueCount = previous.bufferValueCount - suffixValuesBegin;
+		u32 windowValueCount = 0;
+		for (u32 i = 0; i < windowBufferCount; ++i)
+		{
+			windowValueCount += buffers[i]->valueCount;
+		}
+		project.bufferValueCount = prefixValueCount + windowValueCount + suffixValueCount;
+		project.bufferValues = memStackPushArray(permMem, u32, project.bufferValueCount);
+		memcpy(project.bufferValues, previous.bufferValues, prefixValueCount * sizeof(u32));
+
+		auto valuesEnd = prefixValueCount;
+		for (u32 i = 0; i < windowBufferCount; ++i)
+		{
+			auto idx = reuse.prefixBufferCount + i;
+			project.bufferElementTypes[idx] = buffers[i]->elementType;
+			project.bufferNames[idx] = textRangeOf(projectText, buffers[i]->identifier);
+			project.bufferHashes[idx] = buffers[i]->hash;
+			project.bufferValueOffsets[idx] = valuesEnd;
+			memcpy(project.bufferValues + valuesEnd, buffers[i]->values, buffers[i]->valueCount * sizeof(u32));
+			valuesEnd += buffers[i]->valueCount;
+		}
+
+		memcpy(
+			project.bufferValues + valuesEnd, previous.bufferValues + suffixValuesBegin, suffixValueCount * sizeof(u32));
+		for (auto i = reuse.suffixBufferIdx; i < project.bufferCount; ++i)
+		{
+			project.bufferElementTypes[i] = previous.bufferElementTypes[i];
+			project.bufferNames[i] = rebaseRange(previous.bufferNames[i], reuse.suffixOffset);
+			project.bufferHashes[i] = previous.bufferHashes[i];
+			project.bufferValueOffsets[i] = previous.bufferValueOffsets[i] - suffixValuesBegin + valuesEnd;
+		}
+		project.bufferValueOffsets[project.bufferCount] = project.bufferValueCount;
+	}
+
+	// The name table has the same names, and only the text they are found at
+	// moves. A name first found in the text that was parsed again is pointed
+	// at the same name in the new text.
+	project.names.nameCount = previous.names.nameCount;
+	project.names.capacityMask = previous.names.capacityMask;
+	project.names.names = memStackPushArray(permMem, TextRange, project.names.nameCount);
+	project.names.slots = memStackPushArray(permMem, NameTableSlot, project.names.capacityMask + 1);
+	memcpy(project.names.slots, previous.names.slots, (project.names.capacityMask + 1) * sizeof(NameTableSlot));
+	for (u32 nameId = 0; nameId < project.names.nameCount; ++nameId)
+	{
+		auto range = previous.names.names[nameId];
+		project.names.names[nameId] = range.begin < windowEnd ? range : rebaseRange(range, reuse.suffixOffset);
+	}
+	for (u32 i = 0; i < windowShaderCount; ++i)
+	{
+		auto idx = reuse.prefixShaderCount + i;
+		auto nameId = project.shaderNameIds[idx];
+		if (previous.names.names[nameId].begin >= windowBegin && previous.names.names[nameId].begin < windowEnd)
+		{
+			project.names.names[nameId] = project.shaderNames[idx];
+		}
+	}
+	for (u32 i = 0; i < windowProgramCount; ++i)
+	{
+		auto idx = reuse.prefixProgramCount + i;
+		auto nameId = project.programNameIds[idx];
+		if (previous.names.names[nameId].begin >= windowBegin && previous.names.names[nameId].begin < windowEnd)
+		{
+			project.names.names[nameId] = project.programNames[idx];
+		}
+	}
+	for (u32 i = 0; i < windowBufferCount; ++i)
+	{
+		auto idx = reuse.prefixBufferCount + i;
+		auto nameId = project.bufferNameIds[idx];
+		if (previous.names.names[nameId].begin >= windowBegin && previous.names.names[nameId].begin < windowEnd)
+		{
+			project.names.names[nameId] = project.bufferNames[idx];
+		}
+	}
+
+	project.shaderProgramOffsets = memStackPushArray(permMem, u32, project.shaderCount + 1);
+	memcpy(project.shaderProgramOffsets, previous.shaderProgramOffsets, (project.shaderCount + 1) * sizeof(u32));
+	auto shaderProgramCount = project.shaderProgramOffsets[project.shaderCount];
+	project.shaderPrograms = memStackPushArray(permMem, u32, shaderProgramCount);
+	memcpy(project.shaderPrograms, previous.shaderPrograms, shaderProgramCount * sizeof(u32));
+
+	// Only shaders that are attached to programs are compiled, so only those
+	// have their versions checked
+	for (u32 i = 0; i < changedShaderCount; ++i)
+	{
+		auto idx = changedShaders[i];
+		if (project.shaderProgramOffsets[idx + 1] != project.shaderProgramOffsets[idx])
+		{
+			auto source = textRangeSlice(projectText, project.shaderSources[idx]);
+			checkGlslVersion(scratchMem, parser, project.shaderTypes[idx], source);
+		}
+	}
+
+	u32 *changedPrograms;
+	auto changedProgramCount =
+		findProgramsAttachingShaders(scratchMem, project, changedShaders, changedShaderCount, changedPrograms);
+	for (u32 i = 0; i < changedProgramCount; ++i)
+	{
+		auto idx = changedPrograms[i];
+		project.programHashes[idx] = programHash(project, idx);
+		auto location = projectText.begin + project.programNames[idx].begin;
+		checkProgramStages(scratchMem, parser, project, idx, location);
+	}
+
+	// Errors are in the scratch memory, so it is only popped without them
+	if (parser.errorCount == 0)
+	{
+		memStackPop(scratchMem, scratchMemMarker);
+	}
+	result = project;
+	return true;
+}
+
+/// Parses only the declarations that overlap the range of text that changed
+/// since the previous project was parsed. Returns false if the result has
+/// errors, in which case the caller should parse the text in full.
+static bool tryReparseProject(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	Project const& previous,
+	StringSlice projectText,
+	Project& result)
+{
+	auto oldLength = stringSliceLength(previous.text);
+	auto newLength = stringSliceLength(projectText);
+	auto minLength = oldLength < newLength ? oldLength : newLength;
+	auto prefixLength = commonPrefixLength(previous.text.begin, projectText.begin, minLength);
+	auto suffixLength = commonSuffixLength(previous.text.end, projectText.end, minLength - prefixLength);
+	auto changeEnd = oldLength - suffixLength;
+
+	// Text appended directly to the version number changes it, so the change
+	// has to start strictly after the version statement
+	if (prefixLength <= previous.versionEnd)
+	{
+		return false;
+	}
+
+	ReusedDeclarations reuse = {};
+	reuse.previous = &previous;
+	reuse.suffixOffset = (i64) newLength - (i64) oldLength;
+
+	// Declarations end with a delimiter, so text appended directly after one
+	// does not change it.
+	auto resumeOffset = previous.versionEnd;
+	DeclarationCursor next = {};
+	while (next.declarationIdx < previous.declarationCount
+		&& previous.declarations[next.declarationIdx].end <= prefixLength)
+	{
+		resumeOffset = previous.declarations[next.declarationIdx].end;
+		advanceDeclarationCursor(previous, next);
+	}
+	reuse.prefixDeclarationCount = next.declarationIdx;
+	reuse.prefixShaderCount = next.shaderIdx;
+	reuse.prefixProgramCount = next.programIdx;
+	reuse.prefixBufferCount = next.bufferIdx;
+	reuse.prefixIncludeCount = next.includeIdx;
+
+	while (next.declarationIdx < previous.declarationCount
+		&& previous.declarations[next.declarationIdx].begin < changeEnd)
+	{
+		advanceDeclarationCursor(previous, next);
+	}
+
+	// Parsing from a declaration boundary does not depend on any text before it,
+	// so once the cursor reaches the start of an unchanged declaration, the rest
+	// of the previous parse is still valid.
+	ProjectParser parser = {};
+	parser.textBegin = projectText.begin;
+	parser.cursor = projectText.begin + resumeOffset;
+	parser.end = projectText.end;
+	for (;;)
+	{
+		skipWhitespace(parser);
+		if (parser.cursor == parser.end)
+		{
+			break;
+		}
+
+		auto offset = parser.cursor - projectText.begin;
+		while (next.declarationIdx < previous.declarationCount
+			&& previous.declarations[next.declarationIdx].begin + reuse.suffixOffset < offset)
+		{
+			advanceDeclarationCursor(previous, next);
+		}
+		if (next.declarationIdx < previous.declarationCount
+			&& previous.declarations[next.declarationIdx].begin + reuse.suffixOffset == offset)
+		{
+			break;
+		}
+
+		if (!parseDeclaration(scratchMem, parser))
+		{
+			return false;
+		}
+	}
+
+	if (parser.cursor == parser.end)
+	{
+		next.declarationIdx = previous.declarationCount;
+		next.shaderIdx = previous.shaderCount;
+		next.programIdx = previous.programCount;
+		next.bufferIdx = previous.bufferCount;
+		next.includeIdx = previous.includeCount;
+	}
+	reuse.suffixDeclarationIdx = next.declarationIdx;
+	reuse.suffixShaderIdx = next.shaderIdx;
+	reuse.suffixProgramIdx = next.programIdx;
+	reuse.suffixBufferIdx = next.bufferIdx;
+	reuse.suffixIncludeIdx = next.includeIdx;
+
+	// Most edits change the inside of a declaration, which the previous project
+	// is spliced around. Otherwise the project is built again around the parsed
+	// declarations. A project with includes has no reverse index until it is
+	// linked, so it is always built again.
+	auto includeCount =
+		reuse.prefixIncludeCount + parser.includeCount + previous.includeCount - reuse.suffixIncludeIdx;
+	auto projectMemMarker = memStackMark(permMem);
+	Project project;
+	if (!spliceProject(permMem, scratchMem, parser, projectText, reuse, project))
+	{
+		project = buildProject(permMem, scratchMem, parser, projectText, reuse, includeCount != 0);
+	}
+	if (parser.errorCount != 0)
+	{
+		memStackPop(permMem, projectMemMarker);
+		return false;
+	}
+
+	project.version = previous.version;
+	project.versionEnd = previous.versionEnd;
+	result = project;
+	return true;
+}
+
+/// Text that is not parsed again in part is parsed in full, on the worker threads
+Project reparseProject(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	WorkerMemStacks const& workers,
+	Project const& previous,
+	StringSlice projectText,
+	ProjectErrors& errors)
+{
+	assert(previous.text.begin != nullptr);
+
+	Project result;
+	if (tryReparseProject(permMem, scratchMem, previous, projectText, result))
+	{
+		errors = {};
+		return result;
+	}
+	return parseProjectParallel(permMem, scratchMem, workers, projectText, errors);
+}
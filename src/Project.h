@@ -1,5 +1,7 @@
 #pragma once
 
+#include <csetjmp>
+
 enum struct ProjectErrorType
 {
 	MissingVersionStatement,
@@ -18,24 +20,44 @@ enum struct ProjectErrorType
 	DuplicateProgramName,
 	ProgramExceedsAttachedShaderLimit,
 	ProgramUnresolvedShaderIdent,
+	IncludeMissingPath,
+	IncludeUnclosedPath,
+	IncludedFileUnreadable,
+	TooManyIncludedFiles,
+	BufferMissingIdentifier,
+	BufferUnknownElementType,
+	BufferInvalidValue,
+	BufferValueOutOfRange,
+	DuplicateBufferName,
+	GlslVersionUnsupportedByStage,
+	ProgramMixesComputeAndGraphics,
+	ProgramDuplicateShaderStage,
 };
 
+/// Where an error is, for reporting it. Line and character numbers count from one.
 struct TextLocation
 {
 	char *srcPtr;
 	u32 lineNumber, charNumber;
 };
 
+/// The offsets where the lines of a text begin. The first line begins at zero.
+struct LineIndex
+{
+	u32 lineCount;
+	u32 *lineBegins;
+};
+
 struct Token
 {
-	TextLocation location;
 	StringSlice str;
 };
 
 struct ParseProjectError
 {
 	ProjectErrorType type;
-	TextLocation location;
+	/// From the beginning of the text being parsed
+	u32 offset;
 	ParseProjectError *next;
 };
 
@@ -54,35 +76,80 @@ enum struct ShaderType
 	Compute,
 };
 
+/// Parsed declarations are reported at the beginning of their identifiers
 struct ShaderToken
 {
-	TextLocation location;
 	StringSlice identifier;
 	ShaderType type;
 	StringSlice source;
+	u64 hash;
 	ShaderToken *next;
 };
 
 struct AttachedShaderToken
 {
-	TextLocation location;
 	StringSlice identifier;
 };
 
 struct ProgramToken
 {
-	TextLocation location;
 	StringSlice identifier;
 	u32 attachedShaderCount;
 	AttachedShaderToken *attachedShaders;
 	ProgramToken *next;
 };
 
+/// The type of each value of a buffer. Every type is 32 bits wide.
+enum struct BufferElementType
+{
+	F32,
+	U32,
+	I32,
+};
+
+/// A buffer declaration holds a table of numbers, which are converted while
+/// parsing to the binary form they are uploaded to the GPU in
+struct BufferToken
+{
+	StringSlice identifier;
+	BufferElementType elementType;
+	u32 valueCount;
+	/// The bits of each value
+	u32 *values;
+	u64 hash;
+	BufferToken *next;
+};
+
+enum struct DeclarationType
+{
+	Shader,
+	Program,
+	Include,
+	Buffer,
+};
+
+/// An include declaration names another project file, whose declarations are
+/// part of the project. The path is relative to the including file.
+struct IncludeToken
+{
+	/// The offset of the quoted path in the text
+	u32 offset;
+	StringSlice path;
+	IncludeToken *next;
+};
+
+struct DeclarationToken
+{
+	DeclarationType type;
+	StringSlice text;
+	DeclarationToken *next;
+};
+
 struct ProjectParser
 {
+	/// Where offsets in the text are from
+	char *textBegin;
 	char *cursor, *end;
-	u32 lineNumber;
-	char *lineBegin;
 
 	u32 shaderCount;
 	ShaderToken *shaders;
@@ -90,35 +157,239 @@ struct ProjectParser
 	u32 programCount;
 	ProgramToken *programs;
 
+	u32 declarationCount;
+	DeclarationToken *declarations;
+
+	u32 includeCount;
+	IncludeToken *includes;
+
+	u32 bufferCount;
+	BufferToken *buffers;
+
 	u32 errorCount;
 	ParseProjectError *errors;
 };
 
-struct Shader
+struct ValueType;
+typedef bool ValueTypeParseProc(MemStack& mem, ProjectParser& parser, ValueType const& valueType);
+
+/// Describes a kind of declaration, named by the keyword that begins it
+struct ValueType
 {
-	ShaderType type;
-	PackedString name;
-	PackedString source;
+	char const *keyword;
+	DeclarationType declarationType;
+	/// The type of shader declared, for shader declarations
+	ShaderType shaderType;
+	ValueTypeParseProc *parse;
 };
 
-struct Program
+/// A range of a project's text, as offsets from its beginning. Projects refer to
+/// text this way, not with pointers, so that they can be saved and loaded again.
+struct TextRange
 {
-	PackedString name;
-	// The attached shader count does not need to be a large number.
-	// Programs should have nowhere near 255 shaders attached.
-	u8 attachedShaderCount;
-	Shader **attachedShaders;
+	u32 begin, end;
 };
 
+struct NameTableSlot
+{
+	u32 hash;
+	/// The ID of the name plus one, or zero if the slot is empty
+	u32 idPlusOne;
+};
+
+/// Gives each distinct name in a project a dense ID, from zero up to the name
+/// count, so that once names are interned they are compared as integers. IDs
+/// only mean something within the table they come from.
+struct NameTable
+{
+	u32 nameCount;
+	/// The text of each name, by ID, which is where the name was first interned
+	TextRange *names;
+
+	/// An open addressing hash table from names to IDs
+	u32 capacityMask;
+	NameTableSlot *slots;
+};
+
+/// The ID returned when looking up a name that is not in a table
+const u32 invalidNameId = 0xFFFFFFFF;
+
+/// Project text is only parsed on several threads in chunks of at least this
+/// size, because smaller chunks are not worth the cost of starting a thread
+const size_t minParallelChunkSize = 1024 * 1024;
+
+/// Parsing text without errors pushes at most this many bytes for each byte of
+/// text, other than for errors, of which there are a limited number. The most
+/// is pushed for the shaders a program attaches: each is a 16 byte token, and
+/// can be as short as two characters, a one character name and the space or
+/// brace after it. Each kind of declaration takes less than this per character
+/// for the rest of its tokens too. The shortest, such as `Program a{}`, are 11
+/// characters long and push up to 79 bytes. Text with errors can take more,
+/// because the text after a declaration that fails is parsed again.
+const size_t maxParseBytesPerTextByte = 8;
+
+/// A project takes at most this many bytes for each byte of its text. The most
+/// is taken by the shaders a program attaches from other files: each is a four
+/// byte index and an eight byte name, which can fill four eight byte slots of the
+/// name table, for as little as two characters of text.
+const size_t maxProjectBytesPerTextByte = 24;
+
+/// A chunk of project text that is parsed on its own thread. Chunks start at
+/// what looks like the beginning of a declaration, but this is only a guess,
+/// which is checked when the results of all chunks are merged.
+struct ParseChunkJob
+{
+	char *begin, *end;
+	/// The worker stack of the thread the job runs on, and where it was before
+	/// the job pushed to it
+	MemStack *mem;
+	MemStackMarker memMarker;
+	ProjectParser parser;
+	bool success;
+	/// Where the job jumps to if its worker stack runs out of memory, in which
+	/// case the chunk is parsed again by the thread that ran the jobs
+	jmp_buf outOfMemory;
+	bool ranOutOfMemory;
+};
+
+/// An attached shader that did not resolve to a shader of the project
+const u32 unresolvedShader = 0xFFFFFFFF;
+/// Set on an attached shader of a project with includes, before it is linked,
+/// when the shader is declared in another file. The rest of the bits are the ID
+/// of the shader's name.
+const u32 externalShaderFlag = 0x80000000;
+
+struct Include
+{
+	/// Relative to the directory of the file the include is in
+	StringSlice path;
+	/// The offset of the quoted path in the text of the file the include is in
+	u32 offset;
+};
+
+/// The span of a declaration in the project text. These are kept so that when
+/// the project text changes, only the declarations that changed are parsed again.
+struct Declaration
+{
+	DeclarationType type;
+	u32 begin, end;
+};
+
+/// Shaders and programs are stored as parallel arrays, indexed by shader and
+/// program index, so that walking over one of their properties touches only the
+/// memory it needs. Nothing in a project is a pointer, other than the arrays
+/// themselves: text is referred to by offsets, and shaders by index.
 struct Project
 {
+	/// The text the project was parsed from. It must live as long as the project,
+	/// because the names and sources of shaders and programs are ranges of it.
+	StringSlice text;
+
 	Version version;
+	/// The offset of the end of the version statement in the text
+	u32 versionEnd;
+
+	u32 shaderCount;
+	ShaderType *shaderTypes;
+	/// Where each shader's name is in its declaration
+	TextRange *shaderNames;
+	/// The ID of each shader's name in the project's name table
+	u32 *shaderNameIds;
+	TextRange *shaderSources;
+	/// A hash of everything that affects how each shader compiles, its type and
+	/// source. Shaders with equal hashes compile the same way.
+	u64 *shaderHashes;
 
 	u32 programCount;
-	Program *programs;
+	TextRange *programNames;
+	u32 *programNameIds;
+	/// The shaders attached to program i are attachedShaders[j], for j from
+	/// programAttachments[i] up to programAttachments[i + 1]. Each is the index
+	/// of a shader, or unresolvedShader.
+	u32 *programAttachments;
+	u32 attachedShaderCount;
+	u32 *attachedShaders;
+	/// Combines the hashes of each program's attached shaders, in order. Programs
+	/// with equal hashes link the same way.
+	u64 *programHashes;
 
-	u32 shaderCount;
-	Shader *shaders;
+	/// Buffers are parallel arrays too. The values of buffer i are
+	/// bufferValues[j], for j from bufferValueOffsets[i] up to
+	/// bufferValueOffsets[i + 1], stored as the bits of their element type.
+	u32 bufferCount;
+	BufferElementType *bufferElementTypes;
+	TextRange *bufferNames;
+	u32 *bufferNameIds;
+	u32 *bufferValueOffsets;
+	u32 bufferValueCount;
+	u32 *bufferValues;
+	/// A hash of each buffer's element type and values
+	u64 *bufferHashes;
+
+	/// The names of all shaders, programs, and buffers, and of the shaders
+	/// programs attach
+	NameTable names;
+
+	/// All declarations in the order they appear in the text
+	u32 declarationCount;
+	Declaration *declarations;
+
+	/// The programs that attach each shader, in compressed sparse row form. The
+	/// indices of the programs that attach shader i are shaderPrograms[j], for j
+	/// from shaderProgramOffsets[i] up to shaderProgramOffsets[i + 1]. They are in
+	/// ascending order, and each program is listed once per shader.
+	u32 *shaderProgramOffsets;
+	u32 *shaderPrograms;
+
+	/// The files this project's text includes. A project with includes is not
+	/// complete until it is linked with the included files. Until then, shaders
+	/// it attaches to programs but does not declare are marked with
+	/// externalShaderFlag. Once linked, the project's text is the text of all of
+	/// its files, one after another, starting with the project file.
+	u32 includeCount;
+	Include *includes;
+};
+
+/// Describes which declarations of a previously parsed project are carried over
+/// to a new version of its text. The prefix declarations come before the newly
+/// parsed declarations, and the suffix declarations come after them.
+struct ReusedDeclarations
+{
+	Project const *previous;
+
+	u32 prefixDeclarationCount, prefixShaderCount, prefixProgramCount, prefixBufferCount, prefixIncludeCount;
+	u32 suffixDeclarationIdx, suffixShaderIdx, suffixProgramIdx, suffixBufferIdx, suffixIncludeIdx;
+
+	/// Added to the offsets of the suffix declarations, to account for text that
+	/// was inserted or removed before them
+	i64 suffixOffset;
+};
+
+/// Walks the declarations of a project, keeping track of the index of the
+/// shader, program, buffer, or include each one corresponds to
+struct DeclarationCursor
+{
+	u32 declarationIdx, shaderIdx, programIdx, bufferIdx, includeIdx;
+};
+
+/// Parses a project while its text is still being read, so that parsing
+/// overlaps with reading. The text is read into one block of memory, because
+/// the project points into it, and each declaration is parsed as soon as all
+/// of its text has been read.
+struct ProjectStreamParser
+{
+	ProjectParser parser;
+	char *textBegin;
+
+	bool versionParsed;
+	Version version;
+	u32 versionEnd;
+
+	/// A declaration that ran past the end of the text read so far is tried
+	/// again once the text reaches this point
+	char *retryEnd;
+	/// Set when there are too many errors to keep parsing
+	bool stopped;
 };
 
 struct ProjectError
@@ -131,7 +402,51 @@ struct ProjectErrors
 {
 	u32 count;
 	ProjectError *ptr;
+	/// The lines of the text that was parsed, which are indexed to locate the
+	/// errors, and kept so that the lines around the errors can be shown without
+	/// indexing the text again. Not set for errors from linking, which can be in
+	/// any of the linked files.
+	LineIndex lines;
 };
 
 Project parseProject(MemStack& permMem, MemStack& scratchMem, StringSlice projectText, ProjectErrors& errors);
-
+Project parseProjectParallel(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	WorkerMemStacks const& workers,
+	StringSlice projectText,
+	ProjectErrors& errors);
+Project parseIncludedProjectFile(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	WorkerMemStacks const& workers,
+	StringSlice fileText,
+	ProjectErrors& errors);
+Project linkProject(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	Project const *const *files,
+	u32 fileCount,
+	ProjectErrors& errors);
+void beginProjectStream(ProjectStreamParser& stream, char *textBegin);
+void continueProjectStream(MemStack& scratchMem, ProjectStreamParser& stream, char *textEnd);
+Project finishProjectStream(
+	MemStack& permMem, MemStack& scratchMem, ProjectStreamParser& stream, char *textEnd, ProjectErrors& errors);
+Project reparseProject(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	WorkerMemStacks const& workers,
+	Project const& previous,
+	StringSlice projectText,
+	ProjectErrors& errors);
+StringSlice textRangeSlice(StringSlice text, TextRange range);
+LineIndex buildLineIndex(MemStack& mem, StringSlice text);
+TextLocation findTextLocation(LineIndex const& lineIndex, StringSlice text, u32 offset);
+StringSlice findLine(LineIndex const& lineIndex, StringSlice text, u32 lineIdx);
+u32 findNameId(NameTable const& table, StringSlice text, StringSlice name);
+u32 findProgramsAttachingShaders(
+	MemStack& mem,
+	Project const& project,
+	u32 const *shaderIndices,
+	u32 shaderCount,
+	u32*& programIndices);
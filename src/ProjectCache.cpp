@@ -0,0 +1,322 @@
+#include "ProjectCache.h"
+
+// "SBC" followed by a zero byte, in little endian byte order
+static const u32 projectCacheMagic = 0x00434253;
+// Increment this whenever the layout of the cache changes, or projects are
+// checked for more errors, since only projects without errors are cached
+static const u32 projectCacheFormatVersion = 6;
+
+/// Copies an array to the end of a cache being written, and returns its offset.
+/// Every array is aligned for the largest type in a project.
+static u64 writeCacheArray(MemStack& mem, void *header, void const *array, size_t size)
+{
+	auto copy = memStackPushArrayAligned(mem, u8, size, alignof(u64));
+	memcpy(copy, array, size);
+	return (u64) (copy - (u8*) header);
+}
+
+/// Writes a project to a contiguous block of memory in the cache file format,
+/// and returns a pointer to the beginning of the block
+void* serializeProject(MemStack& mem, Project const& project, u64 sourceHash, size_t& size)
+{
+	auto header = memStackPushType(mem, ProjectCacheHeader);
+	*header = {};
+	header->magic = projectCacheMagic;
+	header->formatVersion = projectCacheFormatVersion;
+	header->sourceHash = sourceHash;
+	header->sourceSize = stringSliceLength(project.text);
+	header->version = project.version;
+	header->versionEnd = project.versionEnd;
+	header->shaderCount = project.shaderCount;
+	header->programCount = project.programCount;
+	header->attachedShaderCount = project.attachedShaderCount;
+	header->declarationCount = project.declarationCount;
+	header->nameCount = project.names.nameCount;
+	header->nameSlotCount = project.names.capacityMask + 1;
+	header->bufferCount = project.bufferCount;
+	header->bufferValueCount = project.bufferValueCount;
+
+	auto shaderCount = project.shaderCount;
+	auto programCount = project.programCount;
+	header->shaderTypesOffset =
+		writeCacheArray(mem, header, project.shaderTypes, shaderCount * sizeof(ShaderType));
+	header->shaderNamesOffset =
+		writeCacheArray(mem, header, project.shaderNames, shaderCount * sizeof(TextRange));
+	header->shaderNameIdsOffset =
+		writeCacheArray(mem, header, project.shaderNameIds, shaderCount * sizeof(u32));
+	header->shaderSourcesOffset =
+		writeCacheArray(mem, header, project.shaderSources, shaderCount * sizeof(TextRange));
+	header->shaderHashesOffset =
+		writeCacheArray(mem, header, project.shaderHashes, shaderCount * sizeof(u64));
+	header->programNamesOffset =
+		writeCacheArray(mem, header, project.programNames, programCount * sizeof(TextRange));
+	header->programNameIdsOffset =
+		writeCacheArray(mem, header, project.programNameIds, programCount * sizeof(u32));
+	header->programAttachmentsOffset =
+		writeCacheArray(mem, header, project.programAttachments, (programCount + 1) * sizeof(u32));
+	header->attachedShadersOffset =
+		writeCacheArray(mem, header, project.attachedShaders, project.attachedShaderCount * sizeof(u32));
+	header->programHashesOffset =
+		writeCacheArray(mem, header, project.programHashes, programCount * sizeof(u64));
+	auto bufferCount = project.bufferCount;
+	header->bufferElementTypesOffset =
+		writeCacheArray(mem, header, project.bufferElementTypes, bufferCount * sizeof(BufferElementType));
+	header->bufferNamesOffset =
+		writeCacheArray(mem, header, project.bufferNames, bufferCount * sizeof(TextRange));
+	header->bufferNameIdsOffset =
+		writeCacheArray(mem, header, project.bufferNameIds, bufferCount * sizeof(u32));
+	header->bufferValueOffsetsOffset =
+		writeCacheArray(mem, header, project.bufferValueOffsets, (bufferCount + 1) * sizeof(u32));
+	header->bufferValuesOffset =
+		writeCacheArray(mem, header, project.bufferValues, project.bufferValueCount * sizeof(u32));
+	header->bufferHashesOffset =
+		writeCacheArray(mem, header, project.bufferHashes, bufferCount * sizeof(u64));
+	header->namesOffset =
+		writeCacheArray(mem, header, project.names.names, header->nameCount * sizeof(TextRange));
+	header->nameSlotsOffset =
+		writeCacheArray(mem, header, project.names.slots, header->nameSlotCount * sizeof(NameTableSlot));
+	header->declarationsOffset =
+		writeCacheArray(mem, header, project.declarations, project.declarationCount * sizeof(Declaration));
+
+	size = (size_t) ((u8*) mem.top - (u8*) header);
+	return header;
+}
+
+/// Copies an array out of a cache, if it is inside of the cache. The copy is
+/// aligned for its type, even if the cache is corrupt and the array is not.
+static bool readCacheArray(
+	MemStack& mem,
+	void *cache,
+	size_t cacheSize,
+	u64 offset,
+	size_t elementSize,
+	size_t elementAlignment,
+	u64 count,
+	void *&array)
+{
+	if (offset > cacheSize || count > (cacheSize - offset) / elementSize)
+	{
+		return false;
+	}
+	array = memStackPushArrayAligned(mem, u8, (size_t) count * elementSize, elementAlignment);
+	memcpy(array, (u8*) cache + offset, (size_t) count * elementSize);
+	return true;
+}
+
+#define readCacheArrayOf(mem, cache, cacheSize, offset, count, array) \
+	readCacheArray( \
+		mem, cache, cacheSize, offset, sizeof(*(array)), alignof(decltype(*(array))), count, (void*&) (array))
+
+inline static bool textRangeValid(StringSlice text, TextRange range)
+{
+	return range.begin <= range.end && range.end <= stringSliceLength(text);
+}
+
+/// Loads a project from a cache file, if the cache was built from the given
+/// project text. Everything the project needs is copied out of the cache, so the
+/// cache can be freed afterwards. Nothing is read from the cache without checking
+/// that it is in bounds, and every offset and index is checked before it is
+/// used, so a corrupt cache is rejected, not trusted.
+bool deserializeProject(
+	MemStack& permMem,
+	void *cache,
+	size_t cacheSize,
+	StringSlice projectText,
+	u64 sourceHash,
+	Project& project)
+{
+	if (cacheSize < sizeof(ProjectCacheHeader))
+	{
+		return false;
+	}
+
+	auto header = (ProjectCacheHeader*) cache;
+	if (header->magic != projectCacheMagic
+		|| header->formatVersion != projectCacheFormatVersion
+		|| header->sourceHash != sourceHash
+		|| header->sourceSize != stringSliceLength(projectText))
+	{
+		return false;
+	}
+
+	// The name table must have a power of two slot count, and at least one
+	// empty slot, so that lookups end
+	auto nameSlotCount = header->nameSlotCount;
+	if (nameSlotCount == 0
+		|| (nameSlotCount & (nameSlotCount - 1)) != 0
+		|| header->nameCount >= nameSlotCount)
+	{
+		return false;
+	}
+
+	auto memMarker = memStackMark(permMem);
+
+	Project result = {};
+	result.text = projectText;
+	result.version = header->version;
+	result.versionEnd = header->versionEnd;
+	result.shaderCount = header->shaderCount;
+	result.programCount = header->programCount;
+	result.attachedShaderCount = header->attachedShaderCount;
+	result.declarationCount = header->declarationCount;
+	result.bufferCount = header->bufferCount;
+	result.bufferValueCount = header->bufferValueCount;
+	result.names.nameCount = header->nameCount;
+	result.names.capacityMask = nameSlotCount - 1;
+
+	if (!readCacheArrayOf(permMem, cache, cacheSize, header->shaderTypesOffset, result.shaderCount, result.shaderTypes)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->shaderNamesOffset, result.shaderCount, result.shaderNames)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->shaderNameIdsOffset, result.shaderCount, result.shaderNameIds)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->shaderSourcesOffset, result.shaderCount, result.shaderSources)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->shaderHashesOffset, result.shaderCount, result.shaderHashes)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->programNamesOffset, result.programCount, result.programNames)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->programNameIdsOffset, result.programCount, result.programNameIds)
+		|| !readCacheArrayOf(
+			permMem, cache, cacheSize, header->programAttachmentsOffset, (u64) result.programCount + 1, result.programAttachments)
+		|| !readCacheArrayOf(
+			permMem, cache, cacheSize, header->attachedShadersOffset, result.attachedShaderCount, result.attachedShaders)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->programHashesOffset, result.programCount, result.programHashes)
+		|| !readCacheArrayOf(
+			permMem, cache, cacheSize, header->bufferElementTypesOffset, result.bufferCount, result.bufferElementTypes)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->bufferNamesOffset, result.bufferCount, result.bufferNames)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->bufferNameIdsOffset, result.bufferCount, result.bufferNameIds)
+		|| !readCacheArrayOf(
+			permMem, cache, cacheSize, header->bufferValueOffsetsOffset, (u64) result.bufferCount + 1, result.bufferValueOffsets)
+		|| !readCacheArrayOf(
+			permMem, cache, cacheSize, header->bufferValuesOffset, result.bufferValueCount, result.bufferValues)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->bufferHashesOffset, result.bufferCount, result.bufferHashes)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->namesOffset, result.names.nameCount, result.names.names)
+		|| !readCacheArrayOf(permMem, cache, cacheSize, header->nameSlotsOffset, nameSlotCount, result.names.slots)
+		|| !readCacheArrayOf(
+			permMem, cache, cacheSize, header->declarationsOffset, result.declarationCount, result.declarations))
+	{
+		goto invalidCache;
+	}
+
+	// Declarations are walked in order to find the shader, program, or buffer
+	// each one is, so their types must add up to the counts of each. Projects
+	// with includes are not cached, so there are no include declarations.
+	{
+		u32 shaderCount = 0;
+		u32 programCount = 0;
+		u32 bufferCount = 0;
+		u32 previousEnd = 0;
+		for (u32 i = 0; i < result.declarationCount; ++i)
+		{
+			auto declaration = result.declarations[i];
+			if (!textRangeValid(projectText, TextRange{declaration.begin, declaration.end})
+				|| declaration.begin < previousEnd)
+			{
+				goto invalidCache;
+			}
+			previousEnd = declaration.end;
+
+			switch (declaration.type)
+			{
+			case DeclarationType::Shader:
+				++shaderCount;
+				break;
+			case DeclarationType::Program:
+				++programCount;
+				break;
+			case DeclarationType::Buffer:
+				++bufferCount;
+				break;
+			case DeclarationType::Include:
+			default:
+				goto invalidCache;
+			}
+		}
+		if (shaderCount != result.shaderCount
+			|| programCount != result.programCount
+			|| bufferCount != result.bufferCount)
+		{
+			goto invalidCache;
+		}
+	}
+
+	for (u32 i = 0; i < result.names.nameCount; ++i)
+	{
+		if (!textRangeValid(projectText, result.names.names[i]))
+		{
+			goto invalidCache;
+		}
+	}
+	{
+		u32 usedSlotCount = 0;
+		for (u32 i = 0; i < nameSlotCount; ++i)
+		{
+			auto idPlusOne = result.names.slots[i].idPlusOne;
+			if (idPlusOne > result.names.nameCount)
+			{
+				goto invalidCache;
+			}
+			usedSlotCount += idPlusOne != 0;
+		}
+		if (usedSlotCount > result.names.nameCount)
+		{
+			goto invalidCache;
+		}
+	}
+
+	for (u32 i = 0; i < result.shaderCount; ++i)
+	{
+		if ((u32) result.shaderTypes[i] > (u32) ShaderType::Compute
+			|| !textRangeValid(projectText, result.shaderNames[i])
+			|| result.shaderNameIds[i] >= result.names.nameCount
+			|| !textRangeValid(projectText, result.shaderSources[i]))
+		{
+			goto invalidCache;
+		}
+	}
+
+	if (result.programAttachments[0] != 0
+		|| result.programAttachments[result.programCount] != result.attachedShaderCount)
+	{
+		goto invalidCache;
+	}
+	for (u32 i = 0; i < result.programCount; ++i)
+	{
+		auto begin = result.programAttachments[i];
+		auto end = result.programAttachments[i + 1];
+		if (!textRangeValid(projectText, result.programNames[i])
+			|| result.programNameIds[i] >= result.names.nameCount
+			|| end < begin
+			|| end - begin > 255)
+		{
+			goto invalidCache;
+		}
+	}
+	for (u32 i = 0; i < result.attachedShaderCount; ++i)
+	{
+		if (result.attachedShaders[i] >= result.shaderCount)
+		{
+			goto invalidCache;
+		}
+	}
+
+	if (result.bufferValueOffsets[0] != 0
+		|| result.bufferValueOffsets[result.bufferCount] != result.bufferValueCount)
+	{
+		goto invalidCache;
+	}
+	for (u32 i = 0; i < result.bufferCount; ++i)
+	{
+		if ((u32) result.bufferElementTypes[i] > (u32) BufferElementType::I32
+			|| !textRangeValid(projectText, result.bufferNames[i])
+			|| result.bufferNameIds[i] >= result.names.nameCount
+			|| result.bufferValueOffsets[i + 1] < result.bufferValueOffsets[i])
+		{
+			goto invalidCache;
+		}
+	}
+
+	buildShaderProgramIndex(permMem, result);
+
+	project = result;
+	return true;
+
+invalidCache:
+	memStackPop(permMem, memMarker);
+	return false;
+}
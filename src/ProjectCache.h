@@ -0,0 +1,61 @@
+#pragma once
+
+/// A project cache file holds a parsed project, so that the next time the same
+/// project text is loaded, it can be used without parsing the text again. It is
+/// written next to the project file, with a 'c' appended to the file name.
+///
+/// The file begins with this header. All offsets are in bytes, relative to the
+/// beginning of the header. The arrays of the project are stored as they are in
+/// memory, because they hold offsets and indices, not pointers. Names and
+/// sources are not stored in the cache. They are ranges of the project text.
+/// Buffer values are stored, so that they are not converted from text again.
+struct ProjectCacheHeader
+{
+	u32 magic;
+	u32 formatVersion;
+
+	/// The hash and size of the project text the cache was built from
+	u64 sourceHash;
+	u64 sourceSize;
+
+	Version version;
+	u32 versionEnd;
+
+	u32 shaderCount;
+	u32 programCount;
+	u32 attachedShaderCount;
+	u32 declarationCount;
+	u32 nameCount;
+	u32 nameSlotCount;
+	u32 bufferCount;
+	u32 bufferValueCount;
+
+	u64 shaderTypesOffset;
+	u64 shaderNamesOffset;
+	u64 shaderNameIdsOffset;
+	u64 shaderSourcesOffset;
+	u64 shaderHashesOffset;
+	u64 programNamesOffset;
+	u64 programNameIdsOffset;
+	u64 programAttachmentsOffset;
+	u64 attachedShadersOffset;
+	u64 programHashesOffset;
+	u64 bufferElementTypesOffset;
+	u64 bufferNamesOffset;
+	u64 bufferNameIdsOffset;
+	u64 bufferValueOffsetsOffset;
+	u64 bufferValuesOffset;
+	u64 bufferHashesOffset;
+	u64 namesOffset;
+	u64 nameSlotsOffset;
+	u64 declarationsOffset;
+};
+
+void* serializeProject(MemStack& mem, Project const& project, u64 sourceHash, size_t& size);
+bool deserializeProject(
+	MemStack& permMem,
+	void *cache,
+	size_t cacheSize,
+	StringSlice projectText,
+	u64 sourceHash,
+	Project& project);
@@ -324,16 +324,64 @@ static inline size_t megabytes(size_t value)
 	return value * 1024 * 1024;
 }
 
+static inline size_t gigabytes(size_t value)
+{
+	return value * 1024 * 1024 * 1024;
+}
+
 bool initApplication(ApplicationState& appState)
 {
-	if (!memStackInit(appState.permMem, megabytes(64)))
+	// The stacks only reserve their capacity, and commit memory as they grow into
+	// it, so they are sized for the largest projects, not the typical ones. After
+	// a large project, they shrink back down to what a typical one needs.
+	if (!memStackInit(appState.permMem, gigabytes(1), megabytes(16)))
+	{
+		return false;
+	}
+	if (!memStackInit(appState.scratchMem, gigabytes(4), megabytes(64)))
 	{
 		return false;
 	}
-	if (!memStackInit(appState.scratchMem, megabytes(256)))
+	if (!memStackInit(appState.projectMem, gigabytes(4), megabytes(16)))
 	{
 		return false;
 	}
+	if (!memStackInit(appState.spareProjectMem, gigabytes(4), megabytes(16)))
+	{
+		return false;
+	}
+	memStackRegister(appState.memStacks, appState.permMem, "permanent", 0);
+	memStackRegister(appState.memStacks, appState.scratchMem, "scratch", 0);
+	memStackRegister(appState.memStacks, appState.projectMem, "project", 0);
+	memStackRegister(appState.memStacks, appState.spareProjectMem, "spare project", 0);
+	memStackRegister(appState.memStacks, appState.rootFile.mem, "unlinked project", 0);
+	// The stacks of the included files are registered by slot, since the slots
+	// stay put while the files move between them
+	for (u32 i = 0; i < maxProjectFiles; ++i)
+	{
+		memStackRegister(appState.memStacks, appState.projectFiles[i].mem, "included file", 0);
+	}
+#ifdef MEM_STACK_STATS
+	appState.permMem.sites = &appState.memStackSites;
+	appState.scratchMem.sites = &appState.memStackSites;
+	appState.projectMem.sites = &appState.memStackSites;
+	appState.spareProjectMem.sites = &appState.memStackSites;
+#endif
+
+	auto workerCount = PLATFORM_processorCount();
+	if (workerCount > maxWorkerThreads)
+	{
+		workerCount = maxWorkerThreads;
+	}
+	for (u32 i = 0; i < workerCount; ++i)
+	{
+		if (!memStackInit(appState.workerMem[i], gigabytes(4), megabytes(4)))
+		{
+			return false;
+		}
+		memStackRegister(appState.memStacks, appState.workerMem[i], "worker scratch", i);
+	}
+	appState.workers = WorkerMemStacks{workerCount, appState.workerMem};
 
 	glGenVertexArrays(1, &appState.fillRectRenderConfig.vao);
 	appState.fillRectRenderConfig.program = glCreateProgram();
@@ -588,57 +636,75 @@ static char* projectErrorTypeToString(ProjectErrorType errorType)
 		return "Programs cannot have more than 255 shaders attached";
 	case ProjectErrorType::ProgramUnresolvedShaderIdent:
 		return "No shader with this name exists in this project";
+	case ProjectErrorType::IncludeMissingPath:
+		return "Expected a quoted path to follow 'Include'";
+	case ProjectErrorType::IncludeUnclosedPath:
+		return "Unclosed include path. Paths must be closed with a '\"' on the same line";
+	case ProjectErrorType::IncludedFileUnreadable:
+		return "The included file could not be read";
+	case ProjectErrorType::TooManyIncludedFiles:
+		return "Too many files are included by this project";
+	case ProjectErrorType::BufferMissingIdentifier:
+		return "Expected name for buffer";
+	case ProjectErrorType::BufferUnknownElementType:
+		return "Unknown buffer element type. The element type must be f32, u32, or i32";
+	case ProjectErrorType::BufferInvalidValue:
+		return "Buffer value is not a number of the buffer's element type";
+	case ProjectErrorType::BufferValueOutOfRange:
+		return "Buffer value is out of the range of the buffer's element type";
+	case ProjectErrorType::DuplicateBufferName:
+		return "Another buffer in this project has the same name";
+	case ProjectErrorType::GlslVersionUnsupportedByStage:
+		return "This version of GLSL does not support shaders of this type";
+	case ProjectErrorType::ProgramMixesComputeAndGraphics:
+		return "Programs with a compute shader cannot have shaders of other types attached";
+	case ProjectErrorType::ProgramDuplicateShaderStage:
+		return "Programs cannot have more than one shader of each type attached";
 	default:
 		unreachable();
 		return "???";
 	}
 }
 
-static void stringifyProjectErrors(
-	ApplicationState& app, StringSlice projectText, ProjectErrors const& errors)
+/// Gets the index of the lines of a text, indexing them if they have not been
+/// already. The index is pushed to the memory the text is in, so that it is kept
+/// as long as the text.
+static LineIndex const& indexLines(MemStack& textMem, StringSlice text, LineIndex& lines)
 {
-	auto memMarker = memStackMark(app.scratchMem);
+	if (lines.lineBegins == nullptr)
+	{
+		lines = buildLineIndex(textMem, text);
+	}
+	return lines;
+}
+
+inline static bool textContains(StringSlice text, char *p)
+{
+	return p >= text.begin && p <= text.end;
+}
 
-	// scan through the project text to find line boundaries
-	u32 lineCount = 0;
-	char extraLineCharacter;
-	auto lines = (StringSlice*) app.scratchMem.top;
+/// Finds the included file an error is in. Returns null for errors in the project file.
+static ProjectFile* findErrorFile(ApplicationState& app, StringSlice projectText, ProjectError const& error)
+{
+	if (textContains(projectText, error.location.srcPtr))
+	{
+		return nullptr;
+	}
+	for (u32 i = 0; i < app.projectFileCount; ++i)
 	{
-		auto lineBegin = projectText.begin;
-		auto cursor = projectText.begin;
-		while (cursor != projectText.end)
+		if (textContains(app.projectFiles[i].text, error.location.srcPtr))
 		{
-			switch (*cursor)
-			{
-			case '\n':
-				extraLineCharacter = '\r';
-				break;
-			case '\r':
-				extraLineCharacter = '\n';
-				break;
-			default:
-				++cursor;
-				continue;
-			}
-
-			auto lineBounds = memStackPushType(app.scratchMem, StringSlice);
-			lineBounds->begin = lineBegin;
-			lineBounds->end = cursor;
-			++lineCount;
-			++cursor;
-			if (cursor == projectText.end)
-			{
-				break;
-			}
-			if (*cursor == extraLineCharacter)
-			{
-				++cursor;
-			}
-			lineBegin = cursor;
+			return app.projectFiles + i;
 		}
 	}
+	unreachable();
+	return nullptr;
+}
 
-	app.projectErrorStrings = app.permMem.top;
+static void stringifyProjectErrors(
+	ApplicationState& app, StringSlice projectText, ProjectErrors const& errors)
+{
+	app.projectErrorStrings = memStackAlign(app.permMem, alignof(size_t));
 	app.projectErrorStringCount = 0;
 
 	char *unused1;
@@ -647,6 +713,15 @@ static void stringifyProjectErrors(
 	{
 		auto error = errors.ptr[errorIdx];
 
+		// Only the lines around the error are looked at, and the lines of each
+		// file are indexed at most once, so the time this takes depends on the
+		// number of errors, not on the size of the files
+		auto errorFile = findErrorFile(app, projectText, error);
+		auto text = errorFile == nullptr ? projectText : errorFile->text;
+		auto const& lines = errorFile == nullptr
+			? indexLines(app.projectMem, text, app.projectLines)
+			: indexLines(errorFile->mem, text, errorFile->lines);
+
 		// the number of lines above/below the error to display for context
 		u32 contextLineCount = 2;
 
@@ -659,13 +734,18 @@ static void stringifyProjectErrors(
 		--firstContextLineIdx;
 
 		u32 lastContextLineIdx = error.location.lineNumber + contextLineCount;
-		if (lastContextLineIdx > lineCount)
+		if (lastContextLineIdx > lines.lineCount)
 		{
-			lastContextLineIdx = lineCount;
+			lastContextLineIdx = lines.lineCount;
 		}
 
 		{
 			auto stringBuilder = beginPackedString(app.permMem);
+			if (errorFile != nullptr)
+			{
+				memStackPushString(app.permMem, errorFile->path.path);
+				memStackPushCString(app.permMem, ": ");
+			}
 			memStackPushCString(app.permMem, "Line ");
 			u32ToString(app.permMem, error.location.lineNumber, unused1, unused2);
 			memStackPushCString(app.permMem, ", char ");
@@ -682,7 +762,7 @@ static void stringifyProjectErrors(
 
 		for (u32 i = firstContextLineIdx; i < lastContextLineIdx; ++i)
 		{
-			auto lineBounds = lines[i];
+			auto lineBounds = findLine(lines, text, i);
 
 			{
 				auto stringBuilder = beginPackedString(app.permMem);
@@ -700,8 +780,6 @@ static void stringifyProjectErrors(
 		packCString(app.permMem, "");
 		++app.projectErrorStringCount;
 	}
-
-	memStackPop(app.scratchMem, memMarker);
 }
 
 GLuint glShaderType(ShaderType type)
@@ -724,22 +802,618 @@ void initPreviewProgram(ApplicationState& app)
 {
 }
 
+static inline void swapProjectMem(ApplicationState& app)
+{
+	auto tmp = app.projectMem;
+	app.projectMem = app.spareProjectMem;
+	app.spareProjectMem = tmp;
+}
+
+static FilePath projectCachePath(MemStack& mem, FilePath const projectPath)
+{
+	auto pathLength = stringSliceLength(projectPath.path);
+	auto path = memStackPushArray(mem, char, pathLength + 1);
+	memcpy(path, projectPath.path.begin, pathLength);
+	path[pathLength] = 'c';
+	return FilePath{StringSlice{path, path + pathLength + 1}};
+}
+
+/// Loads the project from its cache file, if the cache is up to date with the project text
+static bool loadProjectCache(ApplicationState& app, StringSlice projectText, Project& project)
+{
+	auto memMarker = memStackMark(app.scratchMem);
+	auto cachePath = projectCachePath(app.scratchMem, app.projectPath);
+	bool success = false;
+	MappedFile projectCache;
+	if (PLATFORM_mapFile(app.scratchMem, cachePath, projectCache))
+	{
+		auto sourceHash = hashStringSlice(projectText);
+		success = deserializeProject(
+			app.projectMem, projectCache.data, projectCache.size, projectText, sourceHash, project);
+		PLATFORM_unmapFile(projectCache);
+	}
+	memStackPop(app.scratchMem, memMarker);
+	return success;
+}
+
+/// Writes the project to its cache file. The cache only speeds up the next
+/// load, so failing to write it is not an error.
+static void saveProjectCache(ApplicationState& app, Project const& project)
+{
+	auto memMarker = memStackMark(app.scratchMem);
+	auto cachePath = projectCachePath(app.scratchMem, app.projectPath);
+	auto sourceHash = hashStringSlice(project.text);
+	size_t cacheSize;
+	auto cache = serializeProject(app.scratchMem, project, sourceHash, cacheSize);
+	PLATFORM_writeWholeFile(app.scratchMem, cachePath, cache, cacheSize);
+	memStackPop(app.scratchMem, memMarker);
+}
+
+/// The cache file only has to exist for loading the project to wait until the
+/// whole text has been read, so that it can be checked against the cache
+static bool projectCacheExists(ApplicationState& app)
+{
+	auto memMarker = memStackMark(app.scratchMem);
+	auto cachePath = projectCachePath(app.scratchMem, app.projectPath);
+	u64 writeStamp;
+	auto result = PLATFORM_getFileWriteStamp(app.scratchMem, cachePath, writeStamp);
+	memStackPop(app.scratchMem, memMarker);
+	return result;
+}
+
+/// Reads the project file in pieces, and parses each piece while the next one
+/// is being read. The text is read straight into the project memory, because the
+/// project points into it, so no other memory is needed to hold the file. Text
+/// that is large enough to be split between the worker threads is parsed faster
+/// on all of them once it has been read than on one thread while it is read, so
+/// then it is only read in pieces.
+static bool streamProjectFile(
+	ApplicationState& app,
+	ReadFileError& readError,
+	StringSlice& projectText,
+	Project& project,
+	ProjectErrors& errors)
+{
+	// Large enough that each read is efficient, and small enough that parsing
+	// does not wait long for the first piece
+	const size_t streamReadSize = 1024 * 1024;
+
+	auto& stream = app.loadFailure.stream;
+	if (!PLATFORM_openFileStream(app.scratchMem, app.projectPath, readError, stream))
+	{
+		return false;
+	}
+	app.loadFailure.streamOpen = true;
+
+	auto textSize = (size_t) stream.size;
+	auto text = memStackPushArrayAligned(app.projectMem, char, textSize, cacheLineSize);
+	auto parallel = app.workers.count > 1 && textSize >= 2 * minParallelChunkSize;
+	ProjectStreamParser parser;
+	beginProjectStream(parser, text);
+
+	bool success = true;
+	size_t readEnd = 0;
+	if (textSize != 0)
+	{
+		auto readSize = textSize < streamReadSize ? textSize : streamReadSize;
+		success = PLATFORM_startFileStreamRead(stream, text, (u32) readSize, readError);
+	}
+	while (success && readEnd < textSize)
+	{
+		u32 bytesRead;
+		if (!PLATFORM_finishFileStreamRead(stream, bytesRead, readError))
+		{
+			success = false;
+			break;
+		}
+		if (bytesRead == 0)
+		{
+			// The file became shorter while it was read
+			readError = ReadFileError::Other;
+			success = false;
+			break;
+		}
+		readEnd += bytesRead;
+
+		if (readEnd < textSize)
+		{
+			auto readSize = textSize - readEnd < streamReadSize ? textSize - readEnd : streamReadSize;
+			if (!PLATFORM_startFileStreamRead(stream, text + readEnd, (u32) readSize, readError))
+			{
+				success = false;
+				break;
+			}
+		}
+		if (!parallel)
+		{
+			continueProjectStream(app.scratchMem, parser, text + readEnd);
+		}
+	}
+	PLATFORM_closeFileStream(stream);
+	app.loadFailure.streamOpen = false;
+
+	if (success)
+	{
+		projectText = StringSlice{text, text + textSize};
+		project = parallel
+			? parseProjectParallel(app.projectMem, app.scratchMem, app.workers, projectText, errors)
+			: finishProjectStream(app.projectMem, app.scratchMem, parser, projectText.end, errors);
+	}
+	return success;
+}
+
+/// Include paths are relative to the directory of the including file, unless they are absolute
+static FilePath resolveIncludePath(MemStack& mem, FilePath const includerPath, StringSlice includePath)
+{
+	auto includePathLength = stringSliceLength(includePath);
+	bool absolute = (includePathLength > 0 && (includePath.begin[0] == '/' || includePath.begin[0] == '\\'))
+		|| (includePathLength > 1 && includePath.begin[1] == ':');
+	auto directoryEnd = includerPath.path.begin;
+	if (!absolute)
+	{
+		for (auto p = includerPath.path.begin; p != includerPath.path.end; ++p)
+		{
+			if (*p == '/' || *p == '\\')
+			{
+				directoryEnd = p + 1;
+			}
+		}
+	}
+
+//TODO paths are not canonicalized, so one file may be cached under several paths
+	auto directoryLength = (size_t) (directoryEnd - includerPath.path.begin);
+	auto path = memStackPushArray(mem, char, directoryLength + includePathLength);
+	memcpy(path, includerPath.path.begin, directoryLength);
+	memcpy(path + directoryLength, includePath.begin, includePathLength);
+	return FilePath{StringSlice{path, path + directoryLength + includePathLength}};
+}
+
+static ProjectFile* findProjectFile(ApplicationState& app, FilePath const path)
+{
+	for (u32 i = 0; i < app.projectFileCount; ++i)
+	{
+		if (app.projectFiles[i].path.path == path.path)
+		{
+			return app.projectFiles + i;
+		}
+	}
+	return nullptr;
+}
+
+/// Reads and parses an included file into memory of its own
+static bool parseProjectFile(ApplicationState& app, ProjectFile& file, FilePath const path, u64 writeStamp)
+{
+	auto memMarker = memStackMark(app.scratchMem);
+	ReadFileError readError;
+	u8 *fileContents;
+	size_t fileSize;
+	PLATFORM_readWholeFile(app.scratchMem, path, readError, fileContents, fileSize);
+	MemStack mem = {};
+	// The memory of a file holds its path, its text, its parse, and the index of
+	// its lines, which is built when there are errors to show in it. The rest is
+	// for errors, of which there are a limited number.
+	size_t capacity = stringSliceLength(path.path) + 1
+		+ (fileSize + 1) * (1 + maxProjectBytesPerTextByte + sizeof(u32))
+		+ megabytes(1);
+	if (fileContents == nullptr || !memStackInit(mem, capacity))
+	{
+		memStackPop(app.scratchMem, memMarker);
+		return false;
+	}
+
+	// The file is parsed as part of loading the project, so it runs out of memory
+	// the same way the project does
+	mem.onFailure = app.projectMem.onFailure;
+	mem.failureData = app.projectMem.failureData;
+
+	// A linked project has its own copy of the text of its files, so nothing
+	// points into the memory of the previous version of the file
+	memStackFree(file.mem);
+	file.mem = mem;
+	file.path = FilePath{memStackPushString(file.mem, path.path)};
+	file.writeStamp = writeStamp;
+	file.watchedWriteStamp = writeStamp;
+	file.text = memStackPushString(file.mem, StringSlice{(char*) fileContents, (char*) fileContents + fileSize});
+	file.project = parseIncludedProjectFile(file.mem, app.scratchMem, app.workers, file.text, file.errors);
+	file.lines = file.errors.lines;
+	app.projectFilesLinked = false;
+	memStackPop(app.scratchMem, memMarker);
+	return true;
+}
+
+/// Keeps the parse of a project file that has includes, so that it is not parsed
+/// again until it changes. The project memory holds nothing but the parse yet,
+/// so it becomes the memory of the project file, and the memory of the previous
+/// version of the project file is what the project is linked into.
+static void keepRootFile(ApplicationState& app, StringSlice projectText, Project const& project, u64 writeStamp)
+{
+	app.projectFilesLinked = false;
+	auto& rootFile = app.rootFile;
+	auto mem = rootFile.mem;
+	if (mem.begin == nullptr)
+	{
+		// Without the memory, the project is linked after the project file's parse,
+		// which is then parsed in full next time
+		if (!memStackInit(mem, gigabytes(4), megabytes(16)))
+		{
+			return;
+		}
+		mem.onFailure = app.projectMem.onFailure;
+		mem.failureData = app.projectMem.failureData;
+#ifdef MEM_STACK_STATS
+		mem.sites = app.projectMem.sites;
+#endif
+	}
+	memStackClear(mem);
+
+	rootFile.mem = app.projectMem;
+	app.projectMem = mem;
+	rootFile.path = app.projectPath;
+	rootFile.writeStamp = writeStamp;
+	rootFile.watchedWriteStamp = writeStamp;
+	rootFile.text = projectText;
+	rootFile.lines = {};
+	rootFile.project = project;
+	rootFile.errors = {};
+}
+
+/// An error about an include, which is in the file that has the include
+struct IncludeError
+{
+	ProjectError error;
+	IncludeError *next;
+};
+
+/// Adds an error about an include. The includer file is null for includes in
+/// the project file.
+static void addIncludeError(
+	ApplicationState& app,
+	ProjectErrorType type,
+	ProjectFile *includerFile,
+	Project const& includer,
+	Include const& include,
+	IncludeError*& errors,
+	u32& errorCount)
+{
+	auto const& lines = includerFile == nullptr
+		? indexLines(app.projectMem, includer.text, app.projectLines)
+		: indexLines(includerFile->mem, includer.text, includerFile->lines);
+
+	auto error = memStackPushType(app.scratchMem, IncludeError);
+	error->error.type = type;
+	error->error.location = findTextLocation(lines, includer.text, include.offset);
+	error->next = errors;
+	errors = error;
+	++errorCount;
+}
+
+/// Finds every file the project includes, directly or through other included
+/// files, and parses the ones that changed since they were last parsed. Each
+/// file is only included once. If none of the files have errors, the project
+/// and the included files are put in the files array, in breadth first order,
+/// for linking.
+static void loadIncludedFiles(
+	ApplicationState& app,
+	Project const& project,
+	Project const**& files,
+	u32& fileCount,
+	ProjectErrors& errors)
+{
+	auto includedFiles = memStackPushArray(app.scratchMem, ProjectFile*, maxProjectFiles);
+	u32 includedFileCount = 0;
+	IncludeError *includeErrors = nullptr;
+	u32 includeErrorCount = 0;
+
+	ProjectFile *includerFile = nullptr;
+	auto includer = &project;
+	auto includerPath = app.projectPath;
+	u32 nextIncluderIdx = 0;
+	for (;;)
+	{
+		for (u32 includeIdx = 0; includeIdx < includer->includeCount; ++includeIdx)
+		{
+			auto const& include = includer->includes[includeIdx];
+			auto path = resolveIncludePath(app.scratchMem, includerPath, include.path);
+			auto file = findProjectFile(app, path);
+			if (path.path == app.projectPath.path || (file != nullptr && file->included))
+			{
+				continue;
+			}
+
+			u64 writeStamp;
+			if (!PLATFORM_getFileWriteStamp(app.scratchMem, path, writeStamp))
+			{
+				addIncludeError(
+					app, ProjectErrorType::IncludedFileUnreadable, includerFile, *includer, include, includeErrors, includeErrorCount);
+				continue;
+			}
+
+			if (file == nullptr)
+			{
+				if (app.projectFileCount == maxProjectFiles)
+				{
+					addIncludeError(
+						app, ProjectErrorType::TooManyIncludedFiles, includerFile, *includer, include, includeErrors, includeErrorCount);
+					continue;
+				}
+				// The file is counted while it is parsed, so that its memory is freed
+				// if the project runs out of memory
+				file = app.projectFiles + app.projectFileCount;
+				*file = {};
+				++app.projectFileCount;
+				if (!parseProjectFile(app, *file, path, writeStamp))
+				{
+					--app.projectFileCount;
+					addIncludeError(
+						app, ProjectErrorType::IncludedFileUnreadable, includerFile, *includer, include, includeErrors, includeErrorCount);
+					continue;
+				}
+			} else if (file->writeStamp != writeStamp && !parseProjectFile(app, *file, path, writeStamp))
+			{
+				addIncludeError(
+					app, ProjectErrorType::IncludedFileUnreadable, includerFile, *includer, include, includeErrors, includeErrorCount);
+				continue;
+			}
+
+			file->included = true;
+			includedFiles[includedFileCount] = file;
+			++includedFileCount;
+		}
+
+		// The includes of files with errors are not known
+		while (nextIncluderIdx < includedFileCount && includedFiles[nextIncluderIdx]->errors.count != 0)
+		{
+			++nextIncluderIdx;
+		}
+		if (nextIncluderIdx == includedFileCount)
+		{
+			break;
+		}
+		includerFile = includedFiles[nextIncluderIdx];
+		includer = &includerFile->project;
+		includerPath = includerFile->path;
+		++nextIncluderIdx;
+	}
+
+	u32 errorCount = includeErrorCount;
+	for (u32 i = 0; i < includedFileCount; ++i)
+	{
+		errorCount += includedFiles[i]->errors.count;
+	}
+	if (errorCount != 0)
+	{
+		errors.count = errorCount;
+		errors.ptr = memStackPushArray(app.scratchMem, ProjectError, errorCount);
+		u32 errorIdx = 0;
+		for (u32 i = 0; i < includedFileCount; ++i)
+		{
+			auto const& fileErrors = includedFiles[i]->errors;
+			memcpy(errors.ptr + errorIdx, fileErrors.ptr, fileErrors.count * sizeof(ProjectError));
+			errorIdx += fileErrors.count;
+		}
+		for (auto pError = includeErrors; pError != nullptr; pError = pError->next)
+		{
+			errors.ptr[errorIdx] = pError->error;
+			++errorIdx;
+		}
+		return;
+	}
+
+	fileCount = includedFileCount + 1;
+	files = memStackPushArray(app.scratchMem, Project const*, fileCount);
+	files[0] = &project;
+	for (u32 i = 0; i < includedFileCount; ++i)
+	{
+		files[i + 1] = &includedFiles[i]->project;
+	}
+}
+
+/// Called once a project has loaded successfully. Files that are no longer
+/// included are freed.
+static void commitProjectFiles(ApplicationState& app)
+{
+	u32 i = 0;
+	while (i < app.projectFileCount)
+	{
+		auto& file = app.projectFiles[i];
+		if (file.included)
+		{
+			++i;
+			continue;
+		}
+		memStackFree(file.mem);
+		--app.projectFileCount;
+		file = app.projectFiles[app.projectFileCount];
+		// Slots past the last file are left empty, because the stack of each slot
+		// is registered
+		app.projectFiles[app.projectFileCount] = {};
+	}
+}
+
+/// Checks whether any file included by the project was written to since it was last checked
+bool includedProjectFilesChanged(ApplicationState& app)
+{
+	bool changed = false;
+	for (u32 i = 0; i < app.projectFileCount; ++i)
+	{
+		auto& file = app.projectFiles[i];
+		if (!file.included)
+		{
+			continue;
+		}
+		u64 writeStamp;
+		if (!PLATFORM_getFileWriteStamp(app.scratchMem, file.path, writeStamp))
+		{
+			writeStamp = 0;
+		}
+		if (writeStamp != file.watchedWriteStamp)
+		{
+			file.watchedWriteStamp = writeStamp;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+static void setReadProjectFileError(ApplicationState& app, char *errorString)
+{
+	auto errorStringLength = (GLint) cStringLength(errorString);
+	app.readProjectFileError.begin = memStackPushArray(app.permMem, char, errorStringLength);
+	app.readProjectFileError.end = app.readProjectFileError.begin + errorStringLength;
+	memcpy(app.readProjectFileError.begin, errorString, errorStringLength);
+}
+
+/// Sets what the stacks a project is loaded into do when they run out of memory
+static void setProjectLoadFailureProc(ApplicationState& app, MemStackFailureProc *proc, void *data)
+{
+	MemStack *stacks[] = {&app.permMem, &app.scratchMem, &app.projectMem, &app.spareProjectMem, &app.rootFile.mem};
+	for (u32 i = 0; i < arrayLength(stacks); ++i)
+	{
+		stacks[i]->onFailure = proc;
+		stacks[i]->failureData = data;
+	}
+	for (u32 i = 0; i < app.projectFileCount; ++i)
+	{
+		app.projectFiles[i].mem.onFailure = proc;
+		app.projectFiles[i].mem.failureData = data;
+	}
+}
+
+static void failProjectLoad(MemStack&, void *data)
+{
+	auto failure = (ProjectLoadFailure*) data;
+	longjmp(failure->jump, 1);
+}
+
+/// Throws away what was loaded of a project that did not fit in memory. The
+/// previous project is kept, because it is in the spare project memory, which
+/// loading only reads from.
+static void freeProjectFiles(ApplicationState& app)
+{
+	for (u32 i = 0; i < app.projectFileCount; ++i)
+	{
+		memStackFree(app.projectFiles[i].mem);
+	}
+	app.projectFileCount = 0;
+}
+
+static void abandonProjectLoad(ApplicationState& app, MemStackMarker scratchMarker)
+{
+	if (app.loadFailure.streamOpen)
+	{
+		PLATFORM_closeFileStream(app.loadFailure.stream);
+		app.loadFailure.streamOpen = false;
+	}
+	setProjectLoadFailureProc(app, nullptr, nullptr);
+
+	swapProjectMem(app);
+	memStackClear(app.spareProjectMem);
+	memStackPop(app.scratchMem, scratchMarker);
+
+	// Included files may have been left partly parsed. Linked projects have their
+	// own copies of their files' text, so the files are read again next time.
+	freeProjectFiles(app);
+
+	memStackClear(app.permMem);
+	app.projectLines = {};
+	app.projectErrorStrings = nullptr;
+	app.projectErrorStringCount = 0;
+	setReadProjectFileError(app, "The project is too large to load");
+}
+
 void loadProject(ApplicationState& app)
 {
 	memStackClear(app.permMem);
 	app.readProjectFileError = {};
+	app.projectLines = {};
 	app.projectErrorStrings = nullptr;
 	app.projectErrorStringCount = 0;
 	app.previewProgramErrors = {};
 
 	auto memMarker = memStackMark(app.scratchMem);
 
+	// Until the new project replaces the current one, running out of memory jumps
+	// back here. Nothing loading a project has a destructor to skip.
+	app.loadFailure.streamOpen = false;
+#ifdef _MSC_VER
+#pragma warning(suppress: 4611)
+#endif
+	if (setjmp(app.loadFailure.jump) != 0)
+	{
+		abandonProjectLoad(app, memMarker);
+		return;
+	}
+	setProjectLoadFailureProc(app, failProjectLoad, &app.loadFailure);
+
+	// The current project moves to the spare memory, where it is kept until the
+	// new version of the project is known to be valid
+	swapProjectMem(app);
+	memStackClear(app.projectMem);
+
 	ReadFileError readError;
-	u8 *fileContents;
-	size_t fileSize;
-	PLATFORM_readWholeFile(app.scratchMem, app.projectPath, readError, fileContents, fileSize);
-	if (fileContents == nullptr)
+	StringSlice projectText = {};
+	ProjectErrors projectErrors = {};
+	Project project = {};
+
+	// A project file with includes is only read again once it changes on disk,
+	// like the files it includes
+	u64 writeStamp;
+	if (!PLATFORM_getFileWriteStamp(app.scratchMem, app.projectPath, writeStamp))
+	{
+		writeStamp = 0;
+	}
+	auto rootFileChanged = app.rootFile.project.text.begin == nullptr
+		|| writeStamp == 0
+		|| writeStamp != app.rootFile.writeStamp;
+
+	// A linked project has the text of all of its files, so the project file is
+	// parsed again from its own parse instead
+	Project const *previous = nullptr;
+	if (app.rootFile.project.text.begin != nullptr)
+	{
+		previous = &app.rootFile.project;
+	} else if (app.project.text.begin != nullptr && app.project.includeCount == 0)
+	{
+		previous = &app.project;
+	}
+
+	// Without a previous project or a cache to compare the text with, nothing
+	// needs the whole text before parsing, so it is parsed as it is read
+	auto streamed = previous == nullptr && !projectCacheExists(app);
+	// A file that becomes shorter while it is read is most likely being saved,
+	// so it is read once more before giving up on it
+	bool readSuccess = false;
+	if (!rootFileChanged)
 	{
+		projectText = app.rootFile.text;
+		project = app.rootFile.project;
+		readSuccess = true;
+	}
+	for (u32 attempt = 0; !readSuccess && attempt < 2; ++attempt)
+	{
+		if (streamed)
+		{
+			readSuccess = streamProjectFile(app, readError, projectText, project, projectErrors);
+		} else
+		{
+			u8 *fileContents;
+			size_t fileSize;
+			PLATFORM_readWholeFile(app.projectMem, app.projectPath, readError, fileContents, fileSize);
+			readSuccess = fileContents != nullptr;
+			projectText = StringSlice{(char*) fileContents, (char*) fileContents + fileSize};
+		}
+		if (readSuccess || readError != ReadFileError::Other)
+		{
+			break;
+		}
+		memStackClear(app.projectMem);
+		memStackPop(app.scratchMem, memMarker);
+	}
+	if (!readSuccess)
+	{
+		setProjectLoadFailureProc(app, nullptr, nullptr);
+		swapProjectMem(app);
+
 		char *errorString;
 		switch (readError)
 		{
@@ -755,7 +1429,6 @@ void loadProject(ApplicationState& app)
 				permissions, or the file may be pending deletion.";
 			break;
 		case ReadFileError::Other:
-			unreachable();
 			errorString = "The project file could not be read";
 			break;
 		default:
@@ -763,22 +1436,73 @@ void loadProject(ApplicationState& app)
 			errorString = "";
 		}
 
-		auto errorStringLength = (GLint) cStringLength(errorString);
-		app.readProjectFileError.begin = memStackPushArray(app.permMem, char, errorStringLength);
-		app.readProjectFileError.end = app.readProjectFileError.begin + errorStringLength;
-		memcpy(app.readProjectFileError.begin, errorString, errorStringLength);
+		setReadProjectFileError(app, errorString);
 		goto exit1;
 	}
 
 	{
-		StringSlice projectText{(char*) fileContents, (char*) fileContents + fileSize}; 
-		ProjectErrors projectErrors = {};
-		app.project = parseProject(app.scratchMem, app.permMem, projectText, projectErrors);
+		if (rootFileChanged && previous != nullptr)
+		{
+			project = reparseProject(
+				app.projectMem, app.scratchMem, app.workers, *previous, projectText, projectErrors);
+		} else if (rootFileChanged && (streamed || !loadProjectCache(app, projectText, project)))
+		{
+			if (!streamed)
+			{
+				project = parseProjectParallel(app.projectMem, app.scratchMem, app.workers, projectText, projectErrors);
+			}
+			// The cache only describes a single file
+			if (projectErrors.count == 0 && project.includeCount == 0)
+			{
+				saveProjectCache(app, project);
+			}
+		}
+
+		// the lines were indexed if there were errors
+		app.projectLines = projectErrors.lines;
+
+		for (u32 i = 0; i < app.projectFileCount; ++i)
+		{
+			app.projectFiles[i].included = false;
+		}
+		if (projectErrors.count == 0 && project.includeCount != 0)
+		{
+			if (rootFileChanged)
+			{
+				keepRootFile(app, projectText, project, writeStamp);
+			}
+			Project const **files = nullptr;
+			u32 fileCount = 0;
+			loadIncludedFiles(app, project, files, fileCount, projectErrors);
+			if (projectErrors.count == 0 && app.projectFilesLinked)
+			{
+				// None of the files changed since the current project was linked from
+				// them, so it is kept, in the memory it was moved out to
+				swapProjectMem(app);
+				project = app.project;
+			} else if (projectErrors.count == 0)
+			{
+				project = linkProject(app.projectMem, app.scratchMem, files, fileCount, projectErrors);
+			}
+		}
 		if (projectErrors.count != 0)
 		{
 			stringifyProjectErrors(app, projectText, projectErrors);
+			// keep the last valid project as the base for the next incremental parse
+			swapProjectMem(app);
 			goto exit1;
 		}
+		app.project = project;
+		commitProjectFiles(app);
+		if (project.includeCount != 0)
+		{
+			app.projectFilesLinked = true;
+		} else
+		{
+			memStackFree(app.rootFile.mem);
+			app.rootFile = {};
+		}
+		setProjectLoadFailureProc(app, nullptr, nullptr);
 	}
 
 	if (stringSliceLength(app.previewProgramName) == 0)
@@ -786,32 +1510,44 @@ void loadProject(ApplicationState& app)
 		goto exit1;
 	}
 
-	Program *previewProgram = nullptr;
+	// The name is looked up once, and then programs are compared by name ID
+	auto previewProgramNameId = findNameId(app.project.names, app.project.text, app.previewProgramName);
+	auto previewProgramIdx = app.project.programCount;
 	for (u32 i = 0; i < app.project.programCount; ++i)
 	{
-		auto projectName = app.project.programs[i].name;
-		if (unpackString(projectName) == app.previewProgramName)
+		if (app.project.programNameIds[i] == previewProgramNameId)
 		{
-			previewProgram = app.project.programs + i;
+			previewProgramIdx = i;
 		}
 	}
-	if (previewProgram == nullptr)
+	if (previewProgramIdx == app.project.programCount)
 	{
 //TODO report error - could not find user program
 		goto exit1;
 	}
 
+	// The program hash covers the type and source of every attached shader, so
+	// an equal hash means the linked program would not change
+	auto previewProgramHash = app.project.programHashes[previewProgramIdx];
+	if (app.previewProgramLinked && previewProgramHash == app.previewProgramHash)
+	{
+		goto exit1;
+	}
+	app.previewProgramLinked = false;
+
 	bool shaderCompilesSuccessful = true;
-	auto shaderCount = previewProgram->attachedShaderCount;
+	auto attachedShaders = app.project.attachedShaders + app.project.programAttachments[previewProgramIdx];
+	auto shaderCount =
+		app.project.programAttachments[previewProgramIdx + 1] - app.project.programAttachments[previewProgramIdx];
 	auto shaders = memStackPushArray(app.scratchMem, GLint, shaderCount);
 	auto errorStringBuilder = beginPackedString(app.permMem);
 	for (u32 i = 0; i < shaderCount; ++i)
 	{
-		auto shader = previewProgram->attachedShaders[i];
-		auto glShader = glCreateShader(glShaderType(shader->type));
+		auto shaderIdx = attachedShaders[i];
+		auto glShader = glCreateShader(glShaderType(app.project.shaderTypes[shaderIdx]));
 		shaders[i] = glShader;
 
-		auto shaderSource = unpackString(shader->source);
+		auto shaderSource = textRangeSlice(app.project.text, app.project.shaderSources[shaderIdx]);
 //TODO there is no guarantee that the shader source will fit in a GLint - bulletproof this
 		auto shaderSourceLength = (GLint) stringSliceLength(shaderSource);
 		glShaderSource(glShader, 1, (GLchar**) &shaderSource.begin, &shaderSourceLength);
@@ -819,7 +1555,8 @@ void loadProject(ApplicationState& app)
 		if (!shaderCompileSuccessful(glShader))
 		{
 			memStackPushCString(app.permMem, "Compile errors in shader '");
-			memStackPushString(app.permMem, unpackString(shader->name));
+			auto shaderName = textRangeSlice(app.project.text, app.project.shaderNames[shaderIdx]);
+			memStackPushString(app.permMem, shaderName);
 			memStackPushCString(app.permMem, "':\n");
 			readShaderLog(app.permMem, glShader);
 			memStackPushCString(app.permMem, "\n");
@@ -846,6 +1583,8 @@ void loadProject(ApplicationState& app)
 
 	endPackedString(app.permMem, errorStringBuilder);
 	app.previewProgramErrors = PackedString{nullptr};
+	app.previewProgramLinked = true;
+	app.previewProgramHash = previewProgramHash;
 
 exit2:
 	for (u32 i = 0; i < shaderCount; ++i)
@@ -856,6 +1595,7 @@ exit2:
 	}
 
 exit1:
+	setProjectLoadFailureProc(app, nullptr, nullptr);
 	memStackPop(app.scratchMem, memMarker);
 }
 
@@ -868,7 +1608,7 @@ static inline void processCommand(ApplicationState& app)
 
 	auto memMarker = memStackMark(app.scratchMem);
 
-	auto args = (StringSlice*) app.scratchMem.top;
+	auto args = (StringSlice*) memStackAlign(app.scratchMem, alignof(StringSlice));
 	u32 argCount = 0;
 	auto p = command.begin;
 	while (p != command.end)
@@ -931,6 +1671,16 @@ static inline void processCommand(ApplicationState& app)
 			auto fileNameArg = args[1];
 			auto fileNameLength = stringSliceLength(fileNameArg);
 			assert(fileNameLength <= sizeof(app.projectPathStorage));
+			if (fileNameArg != app.projectPath.path)
+			{
+				// Nothing from another file's project can be reused. Without a current
+				// project, the new file is streamed or loaded from its own cache.
+				app.project = {};
+				memStackFree(app.rootFile.mem);
+				app.rootFile = {};
+				freeProjectFiles(app);
+				app.previewProgramLinked = false;
+			}
 			memcpy(app.projectPathStorage, fileNameArg.begin, fileNameLength);
 			app.projectPath.path.begin = app.projectPathStorage;
 			app.projectPath.path.end = app.projectPathStorage + fileNameLength;
@@ -956,6 +1706,11 @@ static inline void processCommand(ApplicationState& app)
 		{
 //TODO handle missing argument
 		}
+#ifdef MEM_STACK_STATS
+	} else if (firstArg == "memory-stats")
+	{
+		app.showMemStackStats = !app.showMemStackStats;
+#endif
 	} else
 	{
 //TODO handle unknown command
@@ -1099,7 +1854,16 @@ void updateApplication(ApplicationState& appState)
 
 	auto memMarker = memStackMark(appState.scratchMem);
 
-	auto textLinesBegin = (TextLine*) appState.scratchMem.top;
+#ifdef MEM_STACK_STATS
+	// The report is pushed before the text lines, which have to be contiguous
+	StringSlice memStackStats = {};
+	if (appState.showMemStackStats)
+	{
+		memStackStats = memStackStatsReport(appState.scratchMem, appState.memStacks, &appState.memStackSites, 10);
+	}
+#endif
+
+	auto textLinesBegin = (TextLine*) memStackAlign(appState.scratchMem, alignof(TextLine));
 	{
 		auto commandLineText = memStackPushType(appState.scratchMem, TextLine);
 		commandLineText->leftEdge = 5;
@@ -1119,12 +1883,11 @@ void updateApplication(ApplicationState& appState)
 		if (appState.projectErrorStringCount > 0)
 		{
 			pushSingleTextLine(appState.scratchMem, stringSliceFromCString("Errors in project file:"));
-			auto ptr = (u8*) appState.projectErrorStrings;
+			auto str = PackedString{appState.projectErrorStrings};
 			for (u32 i = 0; i < appState.projectErrorStringCount; ++i)
 			{
-				auto line = unpackString(PackedString{ptr});
-				pushSingleTextLine(appState.scratchMem, line);
-				ptr += sizeof(size_t) + stringSliceLength(line);
+				pushSingleTextLine(appState.scratchMem, unpackString(str));
+				str = nextPackedString(str);
 			}
 		}
 
@@ -1146,6 +1909,23 @@ void updateApplication(ApplicationState& appState)
 			++pTextLine;
 		}
 	}
+#ifdef MEM_STACK_STATS
+	if (appState.showMemStackStats)
+	{
+		// listed up from the bottom left corner of the window
+		auto statsTextLinesBegin = (TextLine*) appState.scratchMem.top;
+		pushMultiTextLine(appState.scratchMem, memStackStats);
+		i32 textBaseline = 10;
+		auto pTextLine = (TextLine*) appState.scratchMem.top;
+		while (pTextLine != statsTextLinesBegin)
+		{
+			--pTextLine;
+			pTextLine->leftEdge = 5;
+			pTextLine->baseline = textBaseline;
+			textBaseline += appState.font.advanceY;
+		}
+	}
+#endif
 	auto textLinesEnd = (TextLine*) appState.scratchMem.top;
 
 	drawText(
@@ -1160,5 +1940,9 @@ void updateApplication(ApplicationState& appState)
 
 	assert(appState.scratchMem.top == appState.scratchMem.begin);
 	memStackClear(appState.scratchMem);
+
+#ifdef MEM_STACK_STATS
+	memStackRegistryEndFrame(appState.memStacks);
+#endif
 }
 
@@ -4,9 +4,11 @@
 #include "Platform.h"
 #include "Common.cpp"
 #include "Project.cpp"
+#include "ProjectCache.cpp"
 #include <gl/gl.h>
 #include "../include/glcorearb.h"
 #include "generated/glFunctions.cpp"
+#include <csetjmp>
 
 struct TextLine
 {
@@ -69,9 +71,62 @@ struct RectI32
 	Vec2I32 min, max;
 };
 
+/// A file included by the project, or the project file itself when it has
+/// includes. Each file is parsed once into its own memory, and is shared by
+/// every file that includes it until it changes on disk.
+struct ProjectFile
+{
+	FilePath path;
+	/// The write stamp of the file when it was parsed
+	u64 writeStamp;
+	/// The write stamp last seen when checking the file for changes, which is zero
+	/// if the file could not be checked
+	u64 watchedWriteStamp;
+	StringSlice text;
+	/// Where the lines of the text begin. The lines are indexed the first time
+	/// an error in the file is reported, and the index is kept until the file
+	/// changes.
+	LineIndex lines;
+	/// Holds the path, text, line index, project, and errors of the file
+	MemStack mem;
+	/// Only valid when there are no errors
+	Project project;
+	ProjectErrors errors;
+	/// Set for the files included by the last project loaded
+	bool included;
+};
+
+const u32 maxProjectFiles = 256;
+const u32 maxWorkerThreads = 64;
+
+/// Loading a project jumps back here when the project needs more memory than
+/// the memory stacks can give it
+struct ProjectLoadFailure
+{
+	jmp_buf jump;
+	/// The stream the project file is read with. It reads into memory that is
+	/// freed after jumping back, so it is kept here, where it can be closed first.
+	FileStream stream;
+	bool streamOpen;
+};
+
 struct ApplicationState
 {
 	MemStack permMem, scratchMem;
+	// The project, and the text it was parsed from, live in the project memory.
+	// The previous project's memory is kept as a spare, so that the previous
+	// project stays valid while the next version is parsed incrementally from it.
+	MemStack projectMem, spareProjectMem;
+	/// Scratch memory for jobs, one stack per thread that jobs run on
+	MemStack workerMem[maxWorkerThreads];
+	WorkerMemStacks workers;
+	MemStackRegistry memStacks;
+#ifdef MEM_STACK_STATS
+	/// Counts the pushes to the stacks used by the main thread
+	MemStackSiteTable memStackSites;
+	/// Toggled with the memory-stats command
+	bool showMemStackStats;
+#endif
 
 	AsciiFont font;
 
@@ -99,10 +154,27 @@ struct ApplicationState
 //TODO put this in the permanent memory
 	char projectPathStorage[256];
 	FilePath projectPath;
+	/// The project file's own parse, from before it was linked with the files
+	/// it includes. It is only kept for projects with includes, and is what the
+	/// next version of the project file is parsed incrementally from.
+	ProjectFile rootFile;
+	u32 projectFileCount;
+	ProjectFile projectFiles[maxProjectFiles];
+	/// Set once the project is linked from the files as they are parsed now, and
+	/// cleared when any of them is parsed again
+	bool projectFilesLinked;
+	ProjectLoadFailure loadFailure;
 //TODO concatenate these error types at project load time
 	StringSlice readProjectFileError;
+	/// Where the lines of the project file being loaded begin, once they are
+	/// indexed to report an error. The index is in the project memory.
+	LineIndex projectLines;
 	void *projectErrorStrings;
 	u32 projectErrorStringCount;
 	PackedString previewProgramErrors;
+	// Set when the preview program linked successfully, so that it is only
+	// built again when the hash of the program changes
+	bool previewProgramLinked;
+	u64 previewProgramHash;
 };
 
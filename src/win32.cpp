@@ -8,22 +8,38 @@
 //TODO printf does not work with Win32 GUI out of the box. Need to do something with AttachConsole/AllocConsole to make it work.
 #define FATAL(message) printf(message); return 1;
 
-inline void* PLATFORM_alloc(size_t size)
+inline void* PLATFORM_reserve(size_t size)
 {
-	return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
 }
 
-inline bool PLATFORM_free(void* memory)
+inline bool PLATFORM_commit(void* memory, size_t size)
+{
+	return VirtualAlloc(memory, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
+inline void PLATFORM_decommit(void* memory, size_t size)
+{
+	VirtualFree(memory, size, MEM_DECOMMIT);
+}
+
+inline bool PLATFORM_free(void* memory, size_t)
 {
 	return VirtualFree(memory, NULL, MEM_RELEASE) != 0;
 }
 
-static HANDLE openFile(MemStack& scratchMem, FilePath const filePath)
+static char* filePathToCString(MemStack& scratchMem, FilePath const filePath)
 {
 	auto filePathLength = stringSliceLength(filePath.path);
 	auto fileNameCString = memStackPushArray(scratchMem, char, filePathLength + 1);
 	memcpy(fileNameCString, filePath.path.begin, filePathLength);
 	fileNameCString[filePathLength] = 0;
+	return fileNameCString;
+}
+
+static HANDLE openFile(MemStack& scratchMem, FilePath const filePath)
+{
+	auto fileNameCString = filePathToCString(scratchMem, filePath);
 	return CreateFileA(fileNameCString, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
 }
 
@@ -71,7 +87,7 @@ void PLATFORM_readWholeFile(
 		fileSize = size.QuadPart;
 	}
 
-	fileContents = memStackPushArray(scratchMem, u8, fileSize);
+	fileContents = memStackPushArrayAligned(scratchMem, u8, fileSize, cacheLineSize);
 
 	DWORD bytesRead;
 	auto readPtr = fileContents;
@@ -108,6 +124,241 @@ success:
 	assert(closeResult != 0);
 }
 
+bool PLATFORM_writeWholeFile(MemStack& scratchMem, FilePath const filePath, void const *data, size_t size)
+{
+	auto fileNameCString = filePathToCString(scratchMem, filePath);
+	HANDLE fileHandle = CreateFileA(
+		fileNameCString, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	bool success = true;
+	DWORD bytesWritten;
+	auto writePtr = (u8 const*) data;
+	auto remainingBytesToWrite = size;
+	const u32 maxWriteSize = 0x40000000;
+	// WriteFile takes a 32-bit size, so large files are written in pieces
+	while (remainingBytesToWrite > 0)
+	{
+		auto writeSize = remainingBytesToWrite > maxWriteSize ? maxWriteSize : (u32) remainingBytesToWrite;
+		if (!WriteFile(fileHandle, writePtr, writeSize, &bytesWritten, NULL) || bytesWritten != writeSize)
+		{
+			success = false;
+			break;
+		}
+		remainingBytesToWrite -= writeSize;
+		writePtr += writeSize;
+	}
+
+	auto closeResult = CloseHandle(fileHandle);
+	assert(closeResult != 0);
+	return success;
+}
+
+bool PLATFORM_mapFile(MemStack& scratchMem, FilePath const filePath, MappedFile& mappedFile)
+{
+	HANDLE fileHandle = openFile(scratchMem, filePath);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	void *data = nullptr;
+	LARGE_INTEGER size;
+	// An empty file cannot be mapped
+	if (GetFileSizeEx(fileHandle, &size) && size.QuadPart > 0)
+	{
+		HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mappingHandle != NULL)
+		{
+			data = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+			// The view keeps a reference to the mapping, so the handle is not needed anymore
+			auto closeResult = CloseHandle(mappingHandle);
+			assert(closeResult != 0);
+		}
+	}
+
+	auto closeResult = CloseHandle(fileHandle);
+	assert(closeResult != 0);
+
+	if (data == nullptr)
+	{
+		return false;
+	}
+	mappedFile.data = data;
+	mappedFile.size = (size_t) size.QuadPart;
+	return true;
+}
+
+void PLATFORM_unmapFile(MappedFile& mappedFile)
+{
+	auto unmapResult = UnmapViewOfFile(mappedFile.data);
+	assert(unmapResult != 0);
+	mappedFile = {};
+}
+
+bool PLATFORM_openFileStream(MemStack& mem, FilePath const filePath, ReadFileError& readError, FileStream& stream)
+{
+	stream = {};
+	auto memMarker = memStackMark(mem);
+	auto fileNameCString = filePathToCString(mem, filePath);
+	HANDLE fileHandle = CreateFileA(
+		fileNameCString,
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		NULL,
+		OPEN_EXISTING,
+		FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN,
+		NULL);
+	memStackPop(mem, memMarker);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		readError = getReadFileError();
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size))
+	{
+		goto error;
+	}
+
+	{
+		auto overlapped = memStackPushType(mem, OVERLAPPED);
+		*overlapped = {};
+		// A manual reset event, which ReadFile resets when a read starts
+		overlapped->hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+		if (overlapped->hEvent == NULL)
+		{
+			memStackPop(mem, memMarker);
+			goto error;
+		}
+
+		stream.handle = fileHandle;
+		stream.readState = overlapped;
+		stream.size = size.QuadPart;
+		return true;
+	}
+
+error:
+	readError = getReadFileError();
+	auto closeResult = CloseHandle(fileHandle);
+	assert(closeResult != 0);
+	return false;
+}
+
+bool PLATFORM_startFileStreamRead(FileStream& stream, void *buffer, u32 size, ReadFileError& readError)
+{
+	assert(!stream.reading);
+	auto overlapped = (OVERLAPPED*) stream.readState;
+	overlapped->Offset = (DWORD) stream.offset;
+	overlapped->OffsetHigh = (DWORD) (stream.offset >> 32);
+	if (!ReadFile(stream.handle, buffer, size, NULL, overlapped) && GetLastError() != ERROR_IO_PENDING)
+	{
+		readError = getReadFileError();
+		return false;
+	}
+	stream.reading = true;
+	return true;
+}
+
+bool PLATFORM_finishFileStreamRead(FileStream& stream, u32& bytesRead, ReadFileError& readError)
+{
+	assert(stream.reading);
+	stream.reading = false;
+	DWORD readSize;
+	if (!GetOverlappedResult(stream.handle, (OVERLAPPED*) stream.readState, &readSize, TRUE))
+	{
+		if (GetLastError() != ERROR_HANDLE_EOF)
+		{
+			readError = getReadFileError();
+			return false;
+		}
+		readSize = 0;
+	}
+	bytesRead = readSize;
+	stream.offset += readSize;
+	return true;
+}
+
+void PLATFORM_closeFileStream(FileStream& stream)
+{
+	auto overlapped = (OVERLAPPED*) stream.readState;
+	if (stream.reading)
+	{
+		// The buffer of a read may be freed once the stream is closed, so the
+		// read has to be stopped first
+		CancelIo(stream.handle);
+		DWORD readSize;
+		GetOverlappedResult(stream.handle, overlapped, &readSize, TRUE);
+		stream.reading = false;
+	}
+
+	auto closeResult = CloseHandle(overlapped->hEvent);
+	assert(closeResult != 0);
+	closeResult = CloseHandle(stream.handle);
+	assert(closeResult != 0);
+	stream = {};
+}
+
+u32 PLATFORM_processorCount()
+{
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return systemInfo.dwNumberOfProcessors;
+}
+
+struct Win32Job
+{
+	PlatformJobProc *proc;
+	void *data;
+};
+
+static DWORD WINAPI win32JobThreadProc(LPVOID param)
+{
+	auto job = (Win32Job*) param;
+	job->proc(job->data);
+	return 0;
+}
+
+void PLATFORM_runJobs(MemStack& scratchMem, PlatformJobProc *proc, void *jobs, size_t jobSize, u32 jobCount)
+{
+	auto memMarker = memStackMark(scratchMem);
+
+	auto win32Jobs = memStackPushArray(scratchMem, Win32Job, jobCount);
+	auto threads = memStackPushArray(scratchMem, HANDLE, jobCount);
+	for (u32 i = 0; i < jobCount; ++i)
+	{
+		win32Jobs[i].proc = proc;
+		win32Jobs[i].data = (u8*) jobs + i * jobSize;
+	}
+
+	// the first job runs on the calling thread
+	for (u32 i = 1; i < jobCount; ++i)
+	{
+		threads[i] = CreateThread(NULL, 0, win32JobThreadProc, win32Jobs + i, 0, NULL);
+		if (threads[i] == NULL)
+		{
+			// running the job here is slower, but still correct
+			proc(win32Jobs[i].data);
+		}
+	}
+	proc(win32Jobs[0].data);
+
+	for (u32 i = 1; i < jobCount; ++i)
+	{
+		if (threads[i] != NULL)
+		{
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+		}
+	}
+
+	memStackPop(scratchMem, memMarker);
+}
+
 bool fileTimesEqual(FILETIME lhs, FILETIME rhs)
 {
 	return lhs.dwLowDateTime == rhs.dwLowDateTime && lhs.dwHighDateTime == rhs.dwHighDateTime;
@@ -138,6 +389,19 @@ success:
 	return result;
 }
 
+bool PLATFORM_getFileWriteStamp(MemStack& scratchMem, FilePath const filePath, u64& stamp)
+{
+	auto memMarker = memStackMark(scratchMem);
+	FILETIME writeTime;
+	auto result = getFileWriteTime(scratchMem, filePath, writeTime);
+	if (result)
+	{
+		stamp = ((u64) writeTime.dwHighDateTime << 32) | writeTime.dwLowDateTime;
+	}
+	memStackPop(scratchMem, memMarker);
+	return result;
+}
+
 char keyBuffer[1024];
 
 ApplicationState appState = {};
@@ -452,6 +716,10 @@ int CALLBACK WinMain(
 				lastProjectFileWriteTime = writeTime;
 				appState.loadProject = true;
 			}
+			if (includedProjectFilesChanged(appState))
+			{
+				appState.loadProject = true;
+			}
 			memStackPop(appState.scratchMem, memMarker);
 		}
 
@@ -0,0 +1,10 @@
+#!/bin/sh
+set -e
+
+projectName=parse-benchmark
+outputDir=build
+
+# Options given to this script are passed on to the compiler, such as
+# -DMEM_STACK_STATS to print statistics on the memory stacks after the run
+mkdir -p $outputDir
+c++ -std=c++11 -O2 -msse2 -Wall -Wno-unused-function -pthread "$@" main.cpp -o $outputDir/$projectName
@@ -0,0 +1,629 @@
+// Measures how fast project files are parsed. Projects are either generated,
+// or read from a file. Results are printed as JSON, so they can be compared
+// across versions. The options are listed in the usage below, which is printed
+// for --help.
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../../src/Types.h"
+#include "../../src/Platform.h"
+#include "../../src/Common.cpp"
+#include "../../src/Project.cpp"
+
+void* PLATFORM_reserve(size_t size)
+{
+	auto memory = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return memory == MAP_FAILED ? nullptr : memory;
+}
+
+bool PLATFORM_commit(void* memory, size_t size)
+{
+	return mprotect(memory, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void PLATFORM_decommit(void* memory, size_t size)
+{
+	madvise(memory, size, MADV_DONTNEED);
+	mprotect(memory, size, PROT_NONE);
+}
+
+bool PLATFORM_free(void* memory, size_t size)
+{
+	return munmap(memory, size) == 0;
+}
+
+u32 PLATFORM_processorCount()
+{
+	auto count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count < 1 ? 1 : (u32) count;
+}
+
+struct LinuxJob
+{
+	PlatformJobProc *proc;
+	void *data;
+};
+
+static void* linuxJobThreadProc(void *param)
+{
+	auto job = (LinuxJob*) param;
+	job->proc(job->data);
+	return nullptr;
+}
+
+void PLATFORM_runJobs(MemStack& scratchMem, PlatformJobProc *proc, void *jobs, size_t jobSize, u32 jobCount)
+{
+	auto memMarker = memStackMark(scratchMem);
+	auto linuxJobs = memStackPushArray(scratchMem, LinuxJob, jobCount);
+	auto threads = memStackPushArray(scratchMem, pthread_t, jobCount);
+	auto threadStarted = memStackPushArray(scratchMem, bool, jobCount);
+
+	// The first job runs on the calling thread
+	for (u32 i = 1; i < jobCount; ++i)
+	{
+		linuxJobs[i] = LinuxJob{proc, (u8*) jobs + i * jobSize};
+		threadStarted[i] = pthread_create(&threads[i], nullptr, linuxJobThreadProc, &linuxJobs[i]) == 0;
+		if (!threadStarted[i])
+		{
+			proc(linuxJobs[i].data);
+		}
+	}
+	proc(jobs);
+	for (u32 i = 1; i < jobCount; ++i)
+	{
+		if (threadStarted[i])
+		{
+			pthread_join(threads[i], nullptr);
+		}
+	}
+
+	memStackPop(scratchMem, memMarker);
+}
+
+struct GeneratorOptions
+{
+	u32 shaderCount;
+	u32 programCount;
+	u32 fanout;
+	u32 bodySize;
+	u32 bufferCount;
+	u32 bufferValueCount;
+	char *marker;
+};
+
+inline static void pushChars(MemStack& mem, char const *str)
+{
+	auto length = cStringLength((char*) str);
+	memcpy(memStackPushArray(mem, char, length), str, length);
+}
+
+inline static void pushU32(MemStack& mem, u32 value)
+{
+	char buffer[16];
+	auto length = snprintf(buffer, sizeof(buffer), "%u", value);
+	memcpy(memStackPushArray(mem, char, length), buffer, length);
+}
+
+static void pushShaderName(MemStack& mem, u32 shaderIdx)
+{
+	pushChars(mem, "shader");
+	pushU32(mem, shaderIdx);
+}
+
+/// Generates GLSL-like lines until the body is the requested size. The lines
+/// contain no '-' characters, so the default markers never appear in a body.
+/// Bodies begin with a version directive, like shaders have to.
+static void pushShaderBody(MemStack& mem, u32 shaderIdx, u32 bodySize)
+{
+	static const char *version = "#version 460\n";
+	static const char *lines[] = {
+		"uniform mat4 transform;\n",
+		"in vec3 position;\n",
+		"out vec4 color;\n",
+		"void main()\n{\n",
+		"\tgl_Position = transform * vec4(position, 1.0);\n",
+		"\tcolor = vec4(position * 0.5 + 0.5, 1.0);\n",
+		"}\n",
+	};
+
+	u32 size = 0;
+	u32 lineIdx = shaderIdx;
+	while (size < bodySize)
+	{
+		auto line = size == 0 ? version : lines[lineIdx % arrayLength(lines)];
+		auto length = (u32) cStringLength((char*) line);
+		if (length > bodySize - size)
+		{
+			length = bodySize - size;
+		}
+		memcpy(memStackPushArray(mem, char, length), line, length);
+		size += length;
+		++lineIdx;
+	}
+}
+
+/// Generates a table of f32 values, eight to a line, like the lookup tables
+/// projects embed. The values have a mix of magnitudes and numbers of digits.
+static void pushBufferValues(MemStack& mem, u32 bufferIdx, u32 valueCount)
+{
+	auto state = bufferIdx * 0x9E3779B1u + 1;
+	for (u32 i = 0; i < valueCount; ++i)
+	{
+		state = state * 1664525 + 1013904223;
+		auto value = (double) (state >> 8) / (1 << 24) * 2.0 - 1.0;
+		char buffer[32];
+		auto length = snprintf(buffer, sizeof(buffer), "%.*g", 3 + (int) (state % 6), value * (1 + state % 1000));
+		memcpy(memStackPushArray(mem, char, length), buffer, length);
+		pushChars(mem, i % 8 == 7 ? "\n" : " ");
+	}
+}
+
+static StringSlice generateProject(MemStack& mem, GeneratorOptions const& options)
+{
+	// Programs attach shaders with consecutive indices, so as long as the fanout
+	// is at most the number of stages, no program has two shaders of one stage.
+	// Compute shaders are left out, since they cannot be attached with others.
+	static const char *shaderKeywords[] = {
+		"VertexShader",
+		"TessControlShader",
+		"TessEvaluationShader",
+		"GeometryShader",
+		"FragmentShader",
+	};
+
+	auto begin = (char*) memStackAlign(mem, cacheLineSize);
+	pushChars(mem, "Version 1.0\n\n");
+
+	for (u32 i = 0; i < options.shaderCount; ++i)
+	{
+		pushChars(mem, shaderKeywords[i % arrayLength(shaderKeywords)]);
+		pushChars(mem, " ");
+		pushShaderName(mem, i);
+		pushChars(mem, "\n");
+		pushChars(mem, options.marker);
+		pushChars(mem, ":\n");
+		pushShaderBody(mem, i, options.bodySize);
+		pushChars(mem, options.marker);
+		pushChars(mem, "\n\n");
+	}
+
+	for (u32 i = 0; i < options.programCount; ++i)
+	{
+		pushChars(mem, "Program program");
+		pushU32(mem, i);
+		pushChars(mem, "\n{\n");
+		if (options.shaderCount != 0)
+		{
+			for (u32 j = 0; j < options.fanout; ++j)
+			{
+				pushChars(mem, "\t");
+				pushShaderName(mem, (i * options.fanout + j) % options.shaderCount);
+				pushChars(mem, "\n");
+			}
+		}
+		pushChars(mem, "}\n\n");
+	}
+
+	for (u32 i = 0; i < options.bufferCount; ++i)
+	{
+		pushChars(mem, "Buffer buffer");
+		pushU32(mem, i);
+		pushChars(mem, " f32\n");
+		pushChars(mem, options.marker);
+		pushChars(mem, ":\n");
+		pushBufferValues(mem, i, options.bufferValueCount);
+		pushChars(mem, options.marker);
+		pushChars(mem, "\n\n");
+	}
+
+	return StringSlice{begin, (char*) mem.top};
+}
+
+static bool readFile(MemStack& mem, char const *fileName, StringSlice& result)
+{
+	auto file = fopen(fileName, "rb");
+	if (!file)
+	{
+		perror("ERROR: unable to open the project file");
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	auto fileSize = (size_t) ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	auto contents = memStackPushArrayAligned(mem, char, fileSize, cacheLineSize);
+	auto readSize = fread(contents, 1, fileSize, file);
+	fclose(file);
+	if (readSize != fileSize)
+	{
+		fprintf(stderr, "ERROR: unable to read the project file\n");
+		return false;
+	}
+
+	result = StringSlice{contents, contents + fileSize};
+	return true;
+}
+
+static bool writeFile(char const *fileName, StringSlice text)
+{
+	auto file = fopen(fileName, "wb");
+	if (!file)
+	{
+		perror("ERROR: unable to open the output file");
+		return false;
+	}
+	auto length = stringSliceLength(text);
+	auto writeSize = fwrite(text.begin, 1, length, file);
+	fclose(file);
+	return writeSize == length;
+}
+
+static const u8 unusedMemoryPattern = 0xCD;
+
+/// Fills an arena with a pattern, so that the amount of it used can be found
+/// afterwards. The whole arena is committed to be painted.
+inline static bool paintMemStack(MemStack& mem)
+{
+	if (!memStackCommit(mem, mem.end))
+	{
+		return false;
+	}
+	memset(mem.top, unusedMemoryPattern, mem.end - mem.top);
+	return true;
+}
+
+/// Returns the number of bytes of an arena that were written to since it was
+/// painted. A written byte that happens to match the pattern at the very end of
+/// the used memory is not counted, so this can be short by a few bytes.
+static size_t memStackHighWater(MemStack const& mem)
+{
+	auto p = mem.end;
+	while (p != mem.begin && p[-1] == unusedMemoryPattern)
+	{
+		--p;
+	}
+	return p - mem.begin;
+}
+
+inline static u64 nanoseconds()
+{
+	timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (u64) time.tv_sec * 1000000000 + (u64) time.tv_nsec;
+}
+
+static int compareU64(void const *lhs, void const *rhs)
+{
+	auto a = *(u64 const*) lhs;
+	auto b = *(u64 const*) rhs;
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static void printJsonString(char const *str)
+{
+	putchar('"');
+	for (auto p = str; *p != 0; ++p)
+	{
+		if (*p == '"' || *p == '\\')
+		{
+			putchar('\\');
+		}
+		putchar(*p);
+	}
+	putchar('"');
+}
+
+static const char usage[] =
+	"usage: parse-benchmark [options]\n"
+	"  --input <file>          benchmark a project file instead of a generated one\n"
+	"  --write <file>          write the generated project to a file, and exit\n"
+	"  --shaders <count>       number of shaders to generate (default 1000)\n"
+	"  --programs <count>      number of programs to generate (default 1000)\n"
+	"  --fanout <count>        shaders attached to each program (default 2)\n"
+	"  --body-size <bytes>     size of each shader's source (default 256)\n"
+	"  --buffers <count>       number of f32 buffers to generate (default 0)\n"
+	"  --buffer-values <count> values in each buffer (default 1000)\n"
+	"  --marker <text>         here string marker (default ---)\n"
+	"  --marker-length <count> use a marker of this many '-' characters instead\n"
+	"  --threads <count>       parse with this many threads (default 1)\n"
+	"  --iterations <count>    number of times to parse the project (default 20)\n"
+	"  --arena-megabytes <size> size of the project, scratch, and worker arenas (default 256)\n"
+	"  --help, -h              print this usage, and exit\n"
+	"  --stream-kilobytes <size> parse the text as a stream, given this many kilobytes\n"
+	"                          at a time, on one thread (default 0, all at once)\n";
+
+static bool parseU32Arg(char const *name, char const *value, u32& result)
+{
+	char *end;
+	auto parsed = strtoul(value, &end, 10);
+	if (*value == 0 || *end != 0 || parsed > 0xFFFFFFFF)
+	{
+		fprintf(stderr, "ERROR: %s expects a number, got '%s'\n", name, value);
+		return false;
+	}
+	result = (u32) parsed;
+	return true;
+}
+
+/// Parses the whole text at once, or as a stream in pieces of the given size,
+/// the way a project file is parsed while it is being read
+static Project parseBenchmarkProject(
+	MemStack& permMem,
+	MemStack& scratchMem,
+	WorkerMemStacks const& workers,
+	StringSlice projectText,
+	size_t streamPieceSize,
+	ProjectErrors& errors)
+{
+	if (streamPieceSize == 0)
+	{
+		return parseProjectParallel(permMem, scratchMem, workers, projectText, errors);
+	}
+
+	ProjectStreamParser parser;
+	beginProjectStream(parser, projectText.begin);
+	auto textEnd = projectText.begin;
+	while (textEnd != projectText.end)
+	{
+		auto remainingSize = (size_t) (projectText.end - textEnd);
+		textEnd += remainingSize < streamPieceSize ? remainingSize : streamPieceSize;
+		continueProjectStream(scratchMem, parser, textEnd);
+	}
+	return finishProjectStream(permMem, scratchMem, parser, projectText.end, errors);
+}
+
+int main(int argc, char **argv)
+{
+	GeneratorOptions generatorOptions = {};
+	generatorOptions.shaderCount = 1000;
+	generatorOptions.programCount = 1000;
+	generatorOptions.fanout = 2;
+	generatorOptions.bodySize = 256;
+	generatorOptions.bufferValueCount = 1000;
+	generatorOptions.marker = (char*) "---";
+	char *inputFileName = nullptr;
+	char *outputFileName = nullptr;
+	u32 markerLength = 0;
+	u32 threadCount = 1;
+	u32 iterationCount = 20;
+	u32 arenaMegabytes = 256;
+	u32 streamKilobytes = 0;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		auto name = argv[i];
+		if (strcmp(name, "--help") == 0 || strcmp(name, "-h") == 0)
+		{
+			fputs(usage, stdout);
+			return 0;
+		}
+		if (i + 1 == argc)
+		{
+			fprintf(stderr, "ERROR: missing value for %s\n", name);
+			return 1;
+		}
+		auto value = argv[++i];
+
+		bool valid = true;
+		if (strcmp(name, "--input") == 0)
+		{
+			inputFileName = value;
+		} else if (strcmp(name, "--write") == 0)
+		{
+			outputFileName = value;
+		} else if (strcmp(name, "--shaders") == 0)
+		{
+			valid = parseU32Arg(name, value, generatorOptions.shaderCount);
+		} else if (strcmp(name, "--programs") == 0)
+		{
+			valid = parseU32Arg(name, value, generatorOptions.programCount);
+		} else if (strcmp(name, "--fanout") == 0)
+		{
+			valid = parseU32Arg(name, value, generatorOptions.fanout);
+		} else if (strcmp(name, "--body-size") == 0)
+		{
+			valid = parseU32Arg(name, value, generatorOptions.bodySize);
+		} else if (strcmp(name, "--buffers") == 0)
+		{
+			valid = parseU32Arg(name, value, generatorOptions.bufferCount);
+		} else if (strcmp(name, "--buffer-values") == 0)
+		{
+			valid = parseU32Arg(name, value, generatorOptions.bufferValueCount);
+		} else if (strcmp(name, "--marker") == 0)
+		{
+			generatorOptions.marker = value;
+		} else if (strcmp(name, "--marker-length") == 0)
+		{
+			valid = parseU32Arg(name, value, markerLength);
+		} else if (strcmp(name, "--threads") == 0)
+		{
+			valid = parseU32Arg(name, value, threadCount);
+		} else if (strcmp(name, "--iterations") == 0)
+		{
+			valid = parseU32Arg(name, value, iterationCount);
+		} else if (strcmp(name, "--arena-megabytes") == 0)
+		{
+			valid = parseU32Arg(name, value, arenaMegabytes);
+		} else if (strcmp(name, "--stream-kilobytes") == 0)
+		{
+			valid = parseU32Arg(name, value, streamKilobytes);
+		} else
+		{
+			fprintf(stderr, "ERROR: unknown option %s\n", name);
+			return 1;
+		}
+
+		if (!valid)
+		{
+			return 1;
+		}
+	}
+
+	if (threadCount == 0 || iterationCount == 0 || arenaMegabytes == 0)
+	{
+		fprintf(stderr, "ERROR: the thread count, iteration count, and arena size must not be zero\n");
+		return 1;
+	}
+
+	if (markerLength != 0)
+	{
+		generatorOptions.marker = (char*) malloc(markerLength + 1);
+		memset(generatorOptions.marker, '-', markerLength);
+		generatorOptions.marker[markerLength] = 0;
+	}
+	if (*generatorOptions.marker == 0 || strpbrk(generatorOptions.marker, ": \t\r\n") != nullptr)
+	{
+		fprintf(stderr, "ERROR: the marker must not be empty, or contain ':' or whitespace\n");
+		return 1;
+	}
+
+	// The text is kept separate from the project arena, so that the high-water
+	// mark of the project arena only includes what the parser allocates
+	MemStack textMem, permMem, scratchMem;
+	auto arenaSize = (size_t) arenaMegabytes * 1024 * 1024;
+	if (!memStackInit(textMem, arenaSize)
+		|| !memStackInit(permMem, arenaSize)
+		|| !memStackInit(scratchMem, arenaSize))
+	{
+		fprintf(stderr, "ERROR: unable to allocate memory\n");
+		return 1;
+	}
+	// Worker stacks are not painted, because there is one per thread. They keep
+	// everything they commit, which is as much as they ever used, to the size of
+	// the blocks they commit in.
+	WorkerMemStacks workers = {threadCount, (MemStack*) malloc(threadCount * sizeof(MemStack))};
+	for (u32 i = 0; i < workers.count; ++i)
+	{
+		if (!memStackInit(workers.stacks[i], arenaSize))
+		{
+			fprintf(stderr, "ERROR: unable to allocate memory\n");
+			return 1;
+		}
+	}
+
+	StringSlice projectText;
+	if (inputFileName != nullptr)
+	{
+		if (!readFile(textMem, inputFileName, projectText))
+		{
+			return 1;
+		}
+	} else
+	{
+		projectText = generateProject(textMem, generatorOptions);
+	}
+
+	if (outputFileName != nullptr)
+	{
+		if (!writeFile(outputFileName, projectText))
+		{
+			fprintf(stderr, "ERROR: unable to write the project file\n");
+			return 1;
+		}
+		return 0;
+	}
+
+#ifdef MEM_STACK_STATS
+	// Each parse is counted as a frame, so the last frame is the last parse
+	MemStackRegistry memStacks = {};
+	memStackRegister(memStacks, permMem, "permanent", 0);
+	memStackRegister(memStacks, scratchMem, "scratch", 0);
+	for (u32 i = 0; i < workers.count; ++i)
+	{
+		memStackRegister(memStacks, workers.stacks[i], "worker scratch", i);
+	}
+	static MemStackSiteTable memStackSites;
+	permMem.sites = &memStackSites;
+	scratchMem.sites = &memStackSites;
+#endif
+
+	// The first parse is not timed. It measures the arena high-water marks, and
+	// warms up the caches and the pages of the arenas.
+	if (!paintMemStack(permMem) || !paintMemStack(scratchMem))
+	{
+		fprintf(stderr, "ERROR: unable to commit the arenas\n");
+		return 1;
+	}
+	ProjectErrors errors = {};
+	auto streamPieceSize = (size_t) streamKilobytes * 1024;
+	auto project = parseBenchmarkProject(permMem, scratchMem, workers, projectText, streamPieceSize, errors);
+	auto permHighWater = memStackHighWater(permMem);
+	auto scratchHighWater = memStackHighWater(scratchMem);
+	size_t workerHighWater = 0;
+	for (u32 i = 0; i < workers.count; ++i)
+	{
+		workerHighWater += workers.stacks[i].committedEnd - workers.stacks[i].begin;
+	}
+	auto declarationCount = project.declarationCount;
+	auto bufferValueCount = project.bufferValueCount;
+	auto errorCount = errors.count;
+
+	auto times = (u64*) malloc(iterationCount * sizeof(u64));
+	for (u32 i = 0; i < iterationCount; ++i)
+	{
+		memStackClear(permMem);
+		memStackClear(scratchMem);
+		ProjectErrors iterationErrors = {};
+		auto startTime = nanoseconds();
+		parseBenchmarkProject(permMem, scratchMem, workers, projectText, streamPieceSize, iterationErrors);
+		times[i] = nanoseconds() - startTime;
+#ifdef MEM_STACK_STATS
+		memStackRegistryEndFrame(memStacks);
+#endif
+	}
+	qsort(times, iterationCount, sizeof(u64), compareU64);
+	auto minTime = times[0];
+	auto medianTime = times[iterationCount / 2];
+
+	auto textSize = stringSliceLength(projectText);
+	auto megabytesPerSecond = medianTime == 0 ? 0.0 : (textSize / (1024.0 * 1024.0)) / (medianTime * 1e-9);
+	auto nsPerDeclaration = declarationCount == 0 ? 0.0 : (double) medianTime / declarationCount;
+
+	printf("{\n");
+	printf("\t\"input\": ");
+	printJsonString(inputFileName != nullptr ? inputFileName : "generated");
+	printf(",\n");
+	if (inputFileName == nullptr)
+	{
+		printf("\t\"generator\": {\n");
+		printf("\t\t\"shaders\": %u,\n", generatorOptions.shaderCount);
+		printf("\t\t\"programs\": %u,\n", generatorOptions.programCount);
+		printf("\t\t\"fanout\": %u,\n", generatorOptions.fanout);
+		printf("\t\t\"bodySize\": %u,\n", generatorOptions.bodySize);
+		printf("\t\t\"buffers\": %u,\n", generatorOptions.bufferCount);
+		printf("\t\t\"bufferValues\": %u,\n", generatorOptions.bufferValueCount);
+		printf("\t\t\"marker\": ");
+		printJsonString(generatorOptions.marker);
+		printf("\n\t},\n");
+	}
+	printf("\t\"threads\": %u,\n", threadCount);
+	printf("\t\"streamKilobytes\": %u,\n", streamKilobytes);
+	printf("\t\"iterations\": %u,\n", iterationCount);
+	printf("\t\"bytes\": %zu,\n", textSize);
+	printf("\t\"declarations\": %u,\n", declarationCount);
+	printf("\t\"bufferValues\": %u,\n", bufferValueCount);
+	printf("\t\"errors\": %u,\n", errorCount);
+	printf("\t\"minNs\": %llu,\n", (unsigned long long) minTime);
+	printf("\t\"medianNs\": %llu,\n", (unsigned long long) medianTime);
+	printf("\t\"megabytesPerSecond\": %.2f,\n", megabytesPerSecond);
+	printf("\t\"nsPerDeclaration\": %.2f,\n", nsPerDeclaration);
+	printf("\t\"permMemHighWater\": %zu,\n", permHighWater);
+	printf("\t\"scratchMemHighWater\": %zu,\n", scratchHighWater);
+	printf("\t\"workerMemHighWater\": %zu\n", workerHighWater);
+	printf("}\n");
+
+#ifdef MEM_STACK_STATS
+	auto memStackStats = memStackStatsReport(textMem, memStacks, &memStackSites, 20);
+	fprintf(stderr, "%.*s\n", (int) stringSliceLength(memStackStats), memStackStats.begin);
+#endif
+
+	return errorCount == 0 ? 0 : 1;
+}